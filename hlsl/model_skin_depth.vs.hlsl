@@ -0,0 +1,9 @@
+#include "shader.hlsli"
+
+
+float4 main(sVSModelDepthSkin vin) : SV_POSITION
+{
+	float3x4 world = skin_mtx((int4)vin.jidx, vin.jwgt);
+	float4 wpos = float4(mul(world, float4(vin.pos, 1)), 1);
+	return mul(wpos, g_viewProj);
+}
@@ -0,0 +1,41 @@
+#include "shader.hlsli"
+
+
+void vs_model(sVSModel vin, out sPSModel vout)
+{
+	float4 real;
+	float4 dual;
+	skin_dq(vin.jidx, vin.jwgt, real, dual);
+
+	float4 pos = float4(dq_transform_pos(real, dual, vin.pos.xyz), 1);
+	float4 wpos = mul(pos, g_world);
+	float4 cpos = mul(wpos, g_viewProj);
+
+	float4 nrm = float4(dq_transform_dir(real, vin.nrm), 0);
+	float4 tgt = float4(dq_transform_dir(real, vin.tgt.xyz), 0);
+	float4 bitgt = float4(dq_transform_dir(real, vin.bitgt), 0);
+	float3 wnrm = mul(nrm, g_world).xyz;
+	float3 wtgt = mul(tgt, g_world).xyz;
+	float3 wbitgt = mul(bitgt, g_world).xyz;
+
+	vout.cpos = cpos;
+	vout.wpos = wpos;
+	vout.wnrm = wnrm;
+	vout.uv = vin.uv;
+	vout.wtgt = float4(wtgt, vin.tgt.w);
+	vout.wbitgt = wbitgt;
+	vout.uv1 = vin.uv1;
+	vout.clr = float4(vin.clr, 1);
+}
+
+#ifdef VTX_PACKED
+void main(sVSModelPackedSkin vin, out sPSModel vout)
+{
+	vs_model(unpack_vtx(vin), vout);
+}
+#else
+void main(sVSModel vin, out sPSModel vout)
+{
+	vs_model(vin, vout);
+}
+#endif
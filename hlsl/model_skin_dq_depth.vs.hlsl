@@ -0,0 +1,12 @@
+#include "shader.hlsli"
+
+
+float4 main(sVSModelDepthSkin vin) : SV_POSITION
+{
+	float4 real;
+	float4 dual;
+	skin_dq((int4)vin.jidx, vin.jwgt, real, dual);
+
+	float4 wpos = mul(float4(dq_transform_pos(real, dual, vin.pos), 1), g_world);
+	return mul(wpos, g_viewProj);
+}
@@ -0,0 +1,2 @@
+#define VTX_PACKED
+#include "model_skin.vs.hlsl"
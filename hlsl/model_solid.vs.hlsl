@@ -1,18 +1,18 @@
 #include "shader.hlsli"
 
 
-void main(sVSModel vin, out sPSModel vout)
+void vs_model(sVSModel vin, float4x4 world, float4 tint, out sPSModel vout)
 {
 	float4 pos = float4(vin.pos.xyz, 1);
-	float4 wpos = mul(pos, g_world);
+	float4 wpos = mul(pos, world);
 	float4 cpos = mul(wpos, g_viewProj);
 
 	float4 nrm = float4(vin.nrm, 0);
 	float4 tgt = float4(vin.tgt.xyz, 0);
 	float4 bitgt = float4(vin.bitgt, 0);
-	float3 wnrm = mul(nrm, g_world).xyz;
-	float3 wtgt = mul(tgt, g_world).xyz;
-	float3 wbitgt = mul(bitgt, g_world).xyz;
+	float3 wnrm = mul(nrm, world).xyz;
+	float3 wtgt = mul(tgt, world).xyz;
+	float3 wbitgt = mul(bitgt, world).xyz;
 
 	vout.cpos = cpos;
 	vout.wpos = wpos;
@@ -21,5 +21,31 @@ void main(sVSModel vin, out sPSModel vout)
 	vout.wtgt = float4(wtgt, vin.tgt.w);
 	vout.wbitgt = wbitgt;
 	vout.uv1 = vin.uv1;
-	vout.clr = float4(vin.clr, 1);
+	vout.clr = float4(vin.clr, 1) * tint;
+}
+
+#ifdef VTX_INSTANCED
+#ifdef VTX_PACKED
+void main(sVSModelPacked vin, sVSInstance inst, out sPSModel vout)
+{
+	vs_model(unpack_vtx(vin), instance_world(inst), inst.tint, vout);
+}
+#else
+void main(sVSModel vin, sVSInstance inst, out sPSModel vout)
+{
+	vs_model(vin, instance_world(inst), inst.tint, vout);
+}
+#endif
+#else
+#ifdef VTX_PACKED
+void main(sVSModelPacked vin, out sPSModel vout)
+{
+	vs_model(unpack_vtx(vin), g_world, 1, vout);
+}
+#else
+void main(sVSModel vin, out sPSModel vout)
+{
+	vs_model(vin, g_world, 1, vout);
 }
+#endif
+#endif
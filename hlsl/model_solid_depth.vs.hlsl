@@ -0,0 +1,8 @@
+#include "shader.hlsli"
+
+
+float4 main(sVSModelDepth vin) : SV_POSITION
+{
+	float4 wpos = mul(float4(vin.pos, 1), g_world);
+	return mul(wpos, g_viewProj);
+}
@@ -0,0 +1,2 @@
+#define VTX_INSTANCED
+#include "model_solid.vs.hlsl"
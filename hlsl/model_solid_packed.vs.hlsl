@@ -0,0 +1,2 @@
+#define VTX_PACKED
+#include "model_solid.vs.hlsl"
@@ -0,0 +1,3 @@
+#define VTX_PACKED
+#define VTX_INSTANCED
+#include "model_solid.vs.hlsl"
@@ -22,6 +22,44 @@ struct sVSModel {
 	float4 jwgt : BLENDWEIGHT;
 };
 
+// Packed layouts, see vtx_fmt.hpp
+struct sVSModelPacked {
+	float3 pos : POSITION;
+	float4 qtgt : QTANGENT;
+	float2 uv : TEXCOORD;
+	float2 uv1 : TEXCOORD1;
+	float3 clr : COLOR;
+};
+
+struct sVSModelPackedSkin {
+	float3 pos : POSITION;
+	float4 qtgt : QTANGENT;
+	float2 uv : TEXCOORD;
+	float2 uv1 : TEXCOORD1;
+	float3 clr : COLOR;
+	uint4  jidx : BLENDINDEX;
+	float4 jwgt : BLENDWEIGHT;
+};
+
+// Position and joint streams of depth passes
+struct sVSModelDepth {
+	float3 pos : POSITION;
+};
+
+struct sVSModelDepthSkin {
+	float3 pos : POSITION;
+	uint4  jidx : BLENDINDEX;
+	float4 jwgt : BLENDWEIGHT;
+};
+
+// Per-instance stream of instanced draws, see sInstanceData
+struct sVSInstance {
+	float4 wmtx0 : INSTANCE0;
+	float4 wmtx1 : INSTANCE1;
+	float4 wmtx2 : INSTANCE2;
+	float4 tint : TINT;
+};
+
 struct sPSModel {
 	float4 cpos : SV_POSITION;
 	float4 wpos : POSITION;
@@ -69,9 +107,17 @@ cbuffer Light : register(b3) {
 	float4 g_lightSH[7];
 };
 
-#define MAX_SKIN_MTX 64
+// Affine skin matrices, transposed and without the constant (0,0,0,1) column.
+// 85 * 3 registers is the same 4KB as 64 full float4x4.
+#define MAX_SKIN_MTX 85
 cbuffer Skin : register(b4) {
-	float4x4 g_skin[MAX_SKIN_MTX];
+	float3x4 g_skin[MAX_SKIN_MTX];
+}
+
+// Pairs of (real, dual) unit dual quaternions in model space
+#define MAX_SKIN_DQ 128
+cbuffer SkinDQ : register(b5) {
+	float4 g_skinDQ[MAX_SKIN_DQ * 2];
 }
 
 Texture2D    g_meshDiffTex : register(t0);
@@ -86,3 +132,85 @@ SamplerState g_meshMaskSmp : register(s3);
 static const float g_gamma = 2.2;
 
 #define PI 3.14159265
+
+
+float3 quat_rotate(float4 q, float3 v) {
+	return v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// QTangent is the rotation of the (t, b, n) frame, sign of w is the bitangent handedness
+void decode_qtangent(float4 qtgt, out float3 nrm, out float4 tgt, out float3 bitgt) {
+	float4 q = normalize(qtgt);
+	float handedness = qtgt.w < 0 ? -1 : 1;
+	nrm = quat_rotate(q, float3(0, 0, 1));
+	float3 t = quat_rotate(q, float3(1, 0, 0));
+	tgt = float4(t, handedness);
+	bitgt = cross(nrm, t) * handedness;
+}
+
+sVSModel unpack_vtx(sVSModelPacked vin) {
+	sVSModel res;
+	res.pos = vin.pos;
+	decode_qtangent(vin.qtgt, res.nrm, res.tgt, res.bitgt);
+	res.uv = vin.uv;
+	res.uv1 = vin.uv1;
+	res.clr = vin.clr;
+	res.jidx = 0;
+	res.jwgt = 0;
+	return res;
+}
+
+sVSModel unpack_vtx(sVSModelPackedSkin vin) {
+	sVSModel res;
+	res.pos = vin.pos;
+	decode_qtangent(vin.qtgt, res.nrm, res.tgt, res.bitgt);
+	res.uv = vin.uv;
+	res.uv1 = vin.uv1;
+	res.clr = vin.clr;
+	res.jidx = (int4)vin.jidx;
+	res.jwgt = vin.jwgt;
+	return res;
+}
+
+// Rows of the instance are the columns of the affine world matrix
+float4x4 instance_world(sVSInstance inst) {
+	return transpose(float4x4(inst.wmtx0, inst.wmtx1, inst.wmtx2, float4(0, 0, 0, 1)));
+}
+
+float3x4 skin_mtx(int4 jidx, float4 jwgt) {
+	float3x4 w0 = g_skin[jidx[0]] * jwgt[0];
+	float3x4 w1 = g_skin[jidx[1]] * jwgt[1];
+	float3x4 w2 = g_skin[jidx[2]] * jwgt[2];
+	float3x4 w3 = g_skin[jidx[3]] * jwgt[3];
+	return w0 + w1 + w2 + w3;
+}
+
+void skin_dq(int4 jidx, float4 jwgt, out float4 real, out float4 dual) {
+	float4 real0 = g_skinDQ[jidx[0] * 2];
+	real = 0;
+	dual = 0;
+
+	[unroll]
+	for (int i = 0; i < 4; ++i) {
+		float4 r = g_skinDQ[jidx[i] * 2];
+		float4 d = g_skinDQ[jidx[i] * 2 + 1];
+		// keep all quaternions in the same hemisphere to blend along the shortest path
+		float w = dot(r, real0) < 0 ? -jwgt[i] : jwgt[i];
+		real += r * w;
+		dual += d * w;
+	}
+
+	float invLen = 1.0 / length(real);
+	real *= invLen;
+	dual *= invLen;
+}
+
+float3 dq_transform_pos(float4 real, float4 dual, float3 pos) {
+	float3 rot = pos + 2 * cross(real.xyz, cross(real.xyz, pos) + real.w * pos);
+	float3 trn = 2 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+	return rot + trn;
+}
+
+float3 dq_transform_dir(float4 real, float3 dir) {
+	return dir + 2 * cross(real.xyz, cross(real.xyz, dir) + real.w * dir);
+}
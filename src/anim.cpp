@@ -1,5 +1,6 @@
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "common.hpp"
 #include "math.hpp"
@@ -470,13 +471,11 @@ void cAnimation::eval(cRig& rig, float frame) const {
 		auto& ch = mpAnimData->mpChannels[chIdx];
 		auto jnt = rig.get_joint(jntIdx);
 
-		auto& xform = jnt->get_xform();
-
 		if (ch.mSubname[0] == 't') {
-			ch.eval(xform.mPos, frame);
+			ch.eval(jnt->edit_xform().mPos, frame);
 		}
 		else if (ch.mSubname[0] == 'r') {
-			ch.eval(xform.mQuat, frame);
+			ch.eval(jnt->edit_xform().mQuat, frame);
 		}
 
 		
@@ -0,0 +1,146 @@
+#include "common.hpp"
+#include "rdr.hpp"
+#include "gfx.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "imgui.hpp"
+
+cGeoHeap::cGeoHeap(ID3D11Device* pDev) : mpDev(pDev) {
+	mIdxAlloc.reset(IDX_POOL_INIT);
+	mIdxBuf.init_default(mpDev, IDX_POOL_INIT, DXGI_FORMAT_R16_UINT);
+}
+
+uint32_t cGeoHeap::get_vtx_pool(uint32_t stride) {
+	for (uint32_t i = 0; i < (uint32_t)mVtxPools.size(); ++i) {
+		if (mVtxPools[i]->mStride == stride) { return i; }
+	}
+	auto pPool = std::make_unique<sVtxPool>();
+	pPool->mStride = stride;
+	pPool->mAlloc.reset(VTX_POOL_INIT);
+	pPool->mBuf.init_default(mpDev, VTX_POOL_INIT, stride);
+	mVtxPools.push_back(std::move(pPool));
+	return (uint32_t)mVtxPools.size() - 1;
+}
+
+// Buffers grow to at least twice the size, the used range is copied on the GPU
+void cGeoHeap::grow_vtx(sVtxPool& pool, uint32_t vtxCount) {
+	auto pCtx = get_gfx().get_imm_ctx();
+	const uint32_t oldCapacity = pool.mAlloc.get_capacity();
+	const uint32_t capacity = std::max(oldCapacity * 2, oldCapacity + vtxCount);
+	cVertexBuffer buf;
+	buf.init_default(mpDev, capacity, pool.mStride);
+	buf.copy_range(pCtx, pool.mBuf, 0, 0, oldCapacity * pool.mStride);
+	pool.mBuf = std::move(buf);
+	pool.mAlloc.grow(capacity);
+	dbg_msg("geo heap: %u byte vertex pool grown to %u vertices\n", pool.mStride, capacity);
+}
+
+void cGeoHeap::grow_idx(uint32_t units) {
+	auto pCtx = get_gfx().get_imm_ctx();
+	const uint32_t oldCapacity = mIdxAlloc.get_capacity();
+	const uint32_t capacity = std::max(oldCapacity * 2, oldCapacity + units);
+	cIndexBuffer buf;
+	buf.init_default(mpDev, capacity, DXGI_FORMAT_R16_UINT);
+	buf.copy_range(pCtx, mIdxBuf, 0, 0, oldCapacity * sizeof(uint16_t));
+	mIdxBuf = std::move(buf);
+	mIdxAlloc.grow(capacity);
+	dbg_msg("geo heap: index pool grown to %u units\n", capacity);
+}
+
+sGeoAlloc cGeoHeap::alloc_vtx(ID3D11DeviceContext* pCtx, void const* pVtx, uint32_t vtxCount, uint32_t stride) {
+	sGeoAlloc res;
+	const uint32_t poolIdx = get_vtx_pool(stride);
+	auto& pool = *mVtxPools[poolIdx];
+	uint32_t handle = pool.mAlloc.alloc(vtxCount);
+	if (handle == cRangeAllocator::INVALID) {
+		grow_vtx(pool, vtxCount);
+		handle = pool.mAlloc.alloc(vtxCount);
+	}
+	if (handle == cRangeAllocator::INVALID) { return res; }
+
+	pool.mBuf.update_range(pCtx, pVtx, pool.mAlloc.get_offset(handle) * stride, vtxCount * stride);
+	res.mPool = poolIdx;
+	res.mHandle = handle;
+	return res;
+}
+
+void cGeoHeap::free_vtx(sGeoAlloc& alloc) {
+	if (!alloc.is_valid()) { return; }
+	mVtxPools[alloc.mPool]->mAlloc.free(alloc.mHandle);
+	alloc = sGeoAlloc();
+}
+
+uint32_t cGeoHeap::alloc_idx(ID3D11DeviceContext* pCtx, uint16_t const* pIdx, uint32_t units) {
+	uint32_t handle = mIdxAlloc.alloc(units, 2);
+	if (handle == cRangeAllocator::INVALID) {
+		grow_idx(units + 1);
+		handle = mIdxAlloc.alloc(units, 2);
+	}
+	if (handle == cRangeAllocator::INVALID) { return handle; }
+
+	mIdxBuf.update_range(pCtx, pIdx, get_idx_offset(handle), units * sizeof(uint16_t));
+	return handle;
+}
+
+void cGeoHeap::free_idx(uint32_t& handle) {
+	mIdxAlloc.free(handle);
+	handle = cRangeAllocator::INVALID;
+}
+
+// Moves are read from a copy of the old buffer, so overlapping ranges are safe
+void cGeoHeap::defrag(ID3D11DeviceContext* pCtx) {
+	std::vector<cRangeAllocator::sMove> moves;
+	mDefragMoves = 0;
+	for (auto& pPool : mVtxPools) {
+		moves.clear();
+		pPool->mAlloc.defrag(moves);
+		if (moves.empty()) { continue; }
+
+		const uint32_t stride = pPool->mStride;
+		const uint32_t capacity = pPool->mAlloc.get_capacity();
+		cVertexBuffer buf;
+		buf.init_default(mpDev, capacity, stride);
+		buf.copy_range(pCtx, pPool->mBuf, 0, 0, capacity * stride);
+		for (auto const& move : moves) {
+			buf.copy_range(pCtx, pPool->mBuf, move.mSrc * stride, move.mDst * stride, move.mSize * stride);
+		}
+		pPool->mBuf = std::move(buf);
+		mDefragMoves += (uint32_t)moves.size();
+	}
+
+	moves.clear();
+	mIdxAlloc.defrag(moves);
+	if (!moves.empty()) {
+		const uint32_t capacity = mIdxAlloc.get_capacity();
+		cIndexBuffer buf;
+		buf.init_default(mpDev, capacity, DXGI_FORMAT_R16_UINT);
+		buf.copy_range(pCtx, mIdxBuf, 0, 0, capacity * sizeof(uint16_t));
+		for (auto const& move : moves) {
+			buf.copy_range(pCtx, mIdxBuf, move.mSrc * sizeof(uint16_t), move.mDst * sizeof(uint16_t), move.mSize * sizeof(uint16_t));
+		}
+		mIdxBuf = std::move(buf);
+		mDefragMoves += (uint32_t)moves.size();
+	}
+}
+
+void cGeoHeap::dbg_ui() {
+	auto show_stats = [](cstr name, cRangeAllocator const& alloc, uint32_t unitSize) {
+		const auto stats = alloc.get_stats();
+		ImGui::LabelText(name, "%.1f/%.1f KB in %u, %u free blocks, frag %.2f",
+			stats.mUsed * unitSize / 1024.0f, stats.mCapacity * unitSize / 1024.0f,
+			stats.mAllocs, stats.mFreeBlocks, stats.get_fragmentation());
+	};
+
+	ImGui::Begin("geo heap");
+	char buf[32];
+	for (auto const& pPool : mVtxPools) {
+		::sprintf_s(buf, "vtx %u", pPool->mStride);
+		show_stats(buf, pPool->mAlloc, pPool->mStride);
+	}
+	show_stats("idx", mIdxAlloc, sizeof(uint16_t));
+	if (ImGui::Button("defrag")) {
+		defrag(get_gfx().get_imm_ctx());
+	}
+	ImGui::LabelText("moves", "%u", mDefragMoves);
+	ImGui::End();
+}
@@ -0,0 +1,57 @@
+#include <memory>
+#include <vector>
+
+// Vertex range of a cGeoHeap pool
+struct sGeoAlloc {
+	uint32_t mPool = cRangeAllocator::INVALID;
+	uint32_t mHandle = cRangeAllocator::INVALID;
+
+	bool is_valid() const { return mHandle != cRangeAllocator::INVALID; }
+};
+
+// Shared vertex and index buffers of models, sub-allocated with cRangeAllocator.
+// Vertex pools are per stride and addressed in vertices, so draws add the base vertex of the range.
+// Indices are addressed in 16 bit units of a single buffer, ranges are 4 byte aligned for 32 bit indices.
+// Growing and defragmentation replace the buffers, so they must not run while frames are recorded.
+class cGeoHeap : noncopyable {
+	struct sVtxPool {
+		uint32_t mStride;
+		cRangeAllocator mAlloc;
+		cVertexBuffer mBuf;
+	};
+
+	ID3D11Device* mpDev;
+	std::vector<std::unique_ptr<sVtxPool>> mVtxPools;
+	cRangeAllocator mIdxAlloc;
+	cIndexBuffer mIdxBuf;
+	uint32_t mDefragMoves = 0;
+
+	uint32_t get_vtx_pool(uint32_t stride);
+	void grow_vtx(sVtxPool& pool, uint32_t vtxCount);
+	void grow_idx(uint32_t units);
+
+public:
+	static const uint32_t VTX_POOL_INIT = 64 * 1024;
+	static const uint32_t IDX_POOL_INIT = 256 * 1024;
+
+	static cGeoHeap& get();
+
+	cGeoHeap(ID3D11Device* pDev);
+
+	sGeoAlloc alloc_vtx(ID3D11DeviceContext* pCtx, void const* pVtx, uint32_t vtxCount, uint32_t stride);
+	void free_vtx(sGeoAlloc& alloc);
+	// Returns the handle of units 16 bit indices
+	uint32_t alloc_idx(ID3D11DeviceContext* pCtx, uint16_t const* pIdx, uint32_t units);
+	void free_idx(uint32_t& handle);
+
+	cVertexBuffer const& get_vtx_buf(sGeoAlloc const& alloc) const { return mVtxPools[alloc.mPool]->mBuf; }
+	uint32_t get_base_vtx(sGeoAlloc const& alloc) const { return mVtxPools[alloc.mPool]->mAlloc.get_offset(alloc.mHandle); }
+	cIndexBuffer const& get_idx_buf() const { return mIdxBuf; }
+	// Byte offset of the range
+	uint32_t get_idx_offset(uint32_t handle) const { return mIdxAlloc.get_offset(handle) * sizeof(uint16_t); }
+
+	// Packs all pools, live ranges keep their handles
+	void defrag(ID3D11DeviceContext* pCtx);
+
+	void dbg_ui();
+};
@@ -0,0 +1,167 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "gfx.hpp"
+#include "model_src.hpp"
+#include "meshlet.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "tri_bvh.hpp"
+#include "tri_sort.hpp"
+#include "vtx_fmt.hpp"
+#include "model.hpp"
+#include "instancing.hpp"
+#include "parallel.hpp"
+#include "imgui.hpp"
+
+#include <chrono>
+#include <cstring>
+
+namespace dx = DirectX;
+
+namespace nInstance {
+
+uint32_t build(sInstance const* pSrc, uint32_t num, sSphere const& sphere, nMeshlet::sCullView const* pView, sInstanceData* pDst) {
+	if (num == 0) { return 0; }
+
+	// Every range is compacted in place from its start, then the ranges are moved together
+	const uint32_t rangesNum = (num + BUILD_GRAIN - 1) / BUILD_GRAIN;
+	std::vector<uint32_t> counts(rangesNum);
+	nParallel::for_ranges(num, BUILD_GRAIN, [&](uint32_t begin, uint32_t end) {
+		uint32_t dst = begin;
+		for (uint32_t i = begin; i < end; ++i) {
+			sInstance const& src = pSrc[i];
+			if (pView) {
+				const sSphere wsphere = sphere.transform(src.mWmtx);
+				const dx::XMVECTOR center = wsphere.get_center();
+				const dx::XMVECTOR negRadius = dx::XMVectorReplicate(-wsphere.get_radius());
+				dx::XMVECTOR outside = dx::XMVectorFalseInt();
+				for (auto const& plane : pView->mPlanes) {
+					outside = dx::XMVectorOrInt(outside, dx::XMVectorLess(dx::XMPlaneDotCoord(plane, center), negRadius));
+				}
+				if (dx::XMVectorGetIntX(outside)) { continue; }
+			}
+
+			const dx::XMMATRIX cols = dx::XMMatrixTranspose(src.mWmtx);
+			sInstanceData& inst = pDst[dst++];
+			dx::XMStoreFloat4(&inst.wmtx[0].mVal, cols.r[0]);
+			dx::XMStoreFloat4(&inst.wmtx[1].mVal, cols.r[1]);
+			dx::XMStoreFloat4(&inst.wmtx[2].mVal, cols.r[2]);
+			inst.tint = src.mTint;
+		}
+		counts[begin / BUILD_GRAIN] = dst - begin;
+	});
+
+	// Destinations never reach past the start of their own range, so moving in order is safe
+	uint32_t visible = counts[0];
+	for (uint32_t i = 1; i < rangesNum; ++i) {
+		if (counts[i] && visible != i * BUILD_GRAIN) {
+			::memmove(&pDst[visible], &pDst[i * BUILD_GRAIN], counts[i] * sizeof(sInstanceData));
+		}
+		visible += counts[i];
+	}
+	return visible;
+}
+
+} // namespace nInstance
+
+
+bool cInstancedModel::init(cModelData const& mdlData, cModelMaterial& mtl) {
+	deinit();
+	if (mdlData.mpSkinVtx) { return false; }
+
+	const eVtxFmt vtxFmt = (eVtxFmt)mdlData.mVtxFmt;
+	cstr layoutVS = nVtxFmt::get_inst_layout_vs(vtxFmt);
+	if (!layoutVS) { return false; }
+
+	auto& ss = cShaderStorage::get();
+	auto pLayoutVS = ss.load_VS(layoutVS);
+	if (!pLayoutVS) { return false; }
+
+	mpGrpVS = std::make_unique<cShader*[]>(mdlData.mGrpNum);
+	for (uint32_t i = 0; i < mdlData.mGrpNum; ++i) {
+		const std::string vsProg = nVtxFmt::get_inst_vs_variant(nVtxFmt::get_vs_variant(mtl.mpGrpMtl[i].vsProg, vtxFmt));
+		mpGrpVS[i] = ss.load_VS(vsProg.c_str());
+		if (!mpGrpVS[i]) { return false; }
+	}
+
+	std::vector<D3D11_INPUT_ELEMENT_DESC> vdsc;
+	nVtxFmt::get_inst_input_desc(vtxFmt, vdsc);
+	auto pDev = get_gfx().get_dev();
+	auto& code = pLayoutVS->get_code();
+	HRESULT hr = pDev->CreateInputLayout(vdsc.data(), (UINT)vdsc.size(), code.get_code(), code.get_size(), mpIL.pp());
+	if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateInputLayout failed");
+
+	mpData = &mdlData;
+	mpMtl = &mtl;
+	return true;
+}
+
+void cInstancedModel::deinit() {
+	mpData = nullptr;
+	mpMtl = nullptr;
+	mpGrpVS.reset();
+	mpIL.reset();
+	mInstBuf.deinit();
+	mpInstData.reset();
+	mCapacity = 0;
+}
+
+void cInstancedModel::reserve(uint32_t capacity) const {
+	if (capacity <= mCapacity) { return; }
+	mCapacity = std::max(capacity, mCapacity * 2);
+	mInstBuf.init_write_only(get_gfx().get_dev(), mCapacity, sizeof(sInstanceData));
+	mpInstData = std::make_unique<sInstanceData[]>(mCapacity);
+}
+
+void cInstancedModel::disp(cRdrContext const& rdrCtx) const {
+	if (!mpData || mInstances.empty()) { return; }
+
+	const uint32_t num = (uint32_t)mInstances.size();
+	reserve(num);
+
+	auto const& cam = rdrCtx.get_cbufs().mCameraCBuf.mData;
+	nMeshlet::sCullView cullView;
+	cullView.init(dx::XMMatrixIdentity(), cam.viewProj, cam.camPos);
+
+	const auto start = std::chrono::steady_clock::now();
+	const uint32_t visible = nInstance::build(mInstances.data(), num, mpData->mSphere, mCull ? &cullView : nullptr, mpInstData.get());
+	mStats.mBuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	mStats.mInstances = num;
+	mStats.mVisible = visible;
+	mStats.mDraws = 0;
+	mStats.mDrawsBefore = num * mpData->mGrpNum;
+	if (visible == 0) { return; }
+
+	auto pCtx = rdrCtx.get_ctx();
+	{
+		auto map = mInstBuf.map(pCtx);
+		if (!map.is_mapped()) { return; }
+		::memcpy(map.data(), mpInstData.get(), visible * sizeof(sInstanceData));
+	}
+
+	pCtx->IASetInputLayout(mpIL);
+	cBlendStates::get().set_opaque(pCtx);
+	mpData->get_vtx().set(pCtx, 0, 0);
+	mInstBuf.set(pCtx, 1, 0);
+
+	for (uint32_t i = 0; i < mpData->mGrpNum; ++i) {
+		sGroup const& grp = mpData->mpGroups[i];
+		mpMtl->apply(rdrCtx, i);
+		pCtx->VSSetShader(mpGrpVS[i]->asVS(), nullptr, 0);
+		mpData->get_idx().set(pCtx, mpData->get_idx_offset() + grp.mIdxOffset, (DXGI_FORMAT)grp.mIdxFormat);
+		pCtx->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)grp.mPolyType);
+		pCtx->DrawIndexedInstanced(grp.mIdxCount, visible, 0, mpData->get_base_vtx() + grp.mBaseVtx, 0);
+		mStats.mDraws++;
+	}
+}
+
+void cInstancedModel::dbg_ui() {
+	if (!mpData) { return; }
+	ImGui::Begin("instancing");
+	ImGui::Checkbox("cull", &mCull);
+	ImGui::LabelText("instances", "%u/%u", mStats.mVisible, mStats.mInstances);
+	ImGui::LabelText("draws", "%u -> %u", mStats.mDrawsBefore, mStats.mDraws);
+	ImGui::LabelText("build", "%.3f ms", mStats.mBuildSeconds * 1000.0);
+	ImGui::End();
+}
@@ -0,0 +1,65 @@
+#include <memory>
+#include <vector>
+
+class cModelData;
+class cModelMaterial;
+class cShader;
+class cRdrContext;
+
+struct sInstance {
+	DirectX::XMMATRIX mWmtx;
+	vec4 mTint;
+};
+
+namespace nInstance {
+
+// Ranges of instances built by one task
+static const uint32_t BUILD_GRAIN = 1024;
+
+// Writes sInstanceData of the instances whose transformed sphere is in view, keeping their order.
+// Without a view all instances are written. pDst must hold num entries, returns the number written.
+// Runs on the CPU only, ranges are built in parallel.
+uint32_t build(sInstance const* pSrc, uint32_t num, sSphere const& sphere, nMeshlet::sCullView const* pView, sInstanceData* pDst);
+
+} // namespace nInstance
+
+struct sInstancingStats {
+	uint32_t mInstances = 0;
+	uint32_t mVisible = 0;
+	// Draw calls of the last frame, against one per group and instance when drawn one by one
+	uint32_t mDraws = 0;
+	uint32_t mDrawsBefore = 0;
+	double mBuildSeconds = 0.0;
+};
+
+// Draws a model once per visible instance with DrawIndexedInstanced.
+// The instance stream replaces the mesh constant buffer, it is rebuilt from mInstances every frame.
+// Groups are drawn at full detail, LOD, meshlets and depth sorting of cModel are not used. Skinned models are rejected.
+class cInstancedModel : noncopyable {
+	cModelData const* mpData = nullptr;
+	cModelMaterial* mpMtl = nullptr;
+
+	com_ptr<ID3D11InputLayout> mpIL;
+	// "_inst" variant of every group's vertex shader
+	std::unique_ptr<cShader*[]> mpGrpVS;
+
+	// Instance buffers grow while drawing
+	mutable uint32_t mCapacity = 0;
+	mutable cVertexBuffer mInstBuf;
+	mutable std::unique_ptr<sInstanceData[]> mpInstData;
+	mutable sInstancingStats mStats;
+
+	void reserve(uint32_t capacity) const;
+
+public:
+	std::vector<sInstance> mInstances;
+	bool mCull = true;
+
+	bool init(cModelData const& mdlData, cModelMaterial& mtl);
+	void deinit();
+
+	void disp(cRdrContext const& rdrCtx) const;
+
+	sInstancingStats const& get_stats() const { return mStats; }
+	void dbg_ui();
+};
@@ -18,6 +18,8 @@ CLANG_DIAG_POP
 #include "scene_objects.hpp"
 #include <imgui.h>
 #include "rdr_queue.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
 
 class cSDLInit {
 public:
@@ -115,6 +117,7 @@ struct sGlobals {
 	GlobalSingleton<cPathManager> pathManager;
 	GlobalSingleton<cSceneMgr> sceneMgr;
 	GlobalSingleton<cRdrQueueMgr> rdrQueueMgr;
+	GlobalSingleton<cGeoHeap> geoHeap;
 };
 
 sGlobals globals;
@@ -133,6 +136,7 @@ cTextureStorage& cTextureStorage::get() { return globals.textureStorage.get(); }
 cPathManager& cPathManager::get() { return globals.pathManager.get(); }
 cSceneMgr& cSceneMgr::get() { return globals.sceneMgr.get(); }
 cRdrQueueMgr& cRdrQueueMgr::get() { return globals.rdrQueueMgr.get(); }
+cGeoHeap& cGeoHeap::get() { return globals.geoHeap.get(); }
 
 void do_frame() {
 	auto& gfx = get_gfx();
@@ -209,6 +213,7 @@ int main(int argc, char* argv[]) {
 	auto rsst = globals.rasterizeStates.ctor_scoped(get_gfx().get_dev());
 	auto dpts = globals.depthStates.ctor_scoped(get_gfx().get_dev());
 	auto rdrQueueMgr = globals.rdrQueueMgr.ctor_scoped(get_gfx());
+	auto geoHeap = globals.geoHeap.ctor_scoped(get_gfx().get_dev());
 	auto imgui = globals.imgui.ctor_scoped(get_gfx());
 	auto scene = globals.sceneMgr.ctor_scoped();
 
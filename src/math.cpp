@@ -1,5 +1,7 @@
 #include "math.hpp"
 
+#include <cfloat>
+
 namespace dx = DirectX;
 
 namespace nMtx {
@@ -79,3 +81,71 @@ DirectX::XMMATRIX XM_CALLCONV sXform::build_mtx() const {
 	res.r[3] = mPos;
 	return res;
 }
+
+void sAABB::init_empty() {
+	mMin = dx::XMVectorReplicate(FLT_MAX);
+	mMax = dx::XMVectorReplicate(-FLT_MAX);
+}
+
+bool sAABB::is_empty() const {
+	return !dx::XMVector3LessOrEqual(mMin, mMax);
+}
+
+void XM_CALLCONV sAABB::add(DirectX::FXMVECTOR pos) {
+	mMin = dx::XMVectorMin(mMin, pos);
+	mMax = dx::XMVectorMax(mMax, pos);
+}
+
+void sAABB::add(sAABB const& box) {
+	mMin = dx::XMVectorMin(mMin, box.mMin);
+	mMax = dx::XMVectorMax(mMax, box.mMax);
+}
+
+sAABB XM_CALLCONV sAABB::transform(DirectX::FXMMATRIX mtx) const {
+	const dx::XMVECTOR center = dx::XMVector3Transform(get_center(), mtx);
+	// Extents of the rotated box are projections of the abs basis
+	dx::XMMATRIX absMtx;
+	absMtx.r[0] = dx::XMVectorAbs(mtx.r[0]);
+	absMtx.r[1] = dx::XMVectorAbs(mtx.r[1]);
+	absMtx.r[2] = dx::XMVectorAbs(mtx.r[2]);
+	absMtx.r[3] = dx::g_XMIdentityR3;
+	const dx::XMVECTOR extents = dx::XMVector3TransformNormal(get_extents(), absMtx);
+
+	sAABB res;
+	res.mMin = dx::XMVectorSubtract(center, extents);
+	res.mMax = dx::XMVectorAdd(center, extents);
+	return res;
+}
+
+DirectX::XMVECTOR sAABB::get_center() const {
+	return dx::XMVectorScale(dx::XMVectorAdd(mMin, mMax), 0.5f);
+}
+
+DirectX::XMVECTOR sAABB::get_extents() const {
+	return dx::XMVectorScale(dx::XMVectorSubtract(mMax, mMin), 0.5f);
+}
+
+sSphere sSphere::around(sAABB const& box, DirectX::XMFLOAT3 const* pPts, uint32_t const* pIdx, uint32_t num, uint32_t stride) {
+	const dx::XMVECTOR center = box.get_center();
+	dx::XMVECTOR radiusSq = dx::XMVectorZero();
+	uint8_t const* pBase = reinterpret_cast<uint8_t const*>(pPts);
+	for (uint32_t i = 0; i < num; ++i) {
+		const uint32_t idx = pIdx ? pIdx[i] : i;
+		const dx::XMVECTOR pt = dx::XMLoadFloat3(reinterpret_cast<dx::XMFLOAT3 const*>(pBase + size_t(idx) * stride));
+		radiusSq = dx::XMVectorMax(radiusSq, dx::XMVector3LengthSq(dx::XMVectorSubtract(pt, center)));
+	}
+	sSphere res;
+	res.mVal = dx::XMVectorSelect(center, dx::XMVectorSqrt(radiusSq), dx::g_XMSelect0001);
+	return res;
+}
+
+sSphere XM_CALLCONV sSphere::transform(DirectX::FXMMATRIX mtx) const {
+	const dx::XMVECTOR center = dx::XMVector3Transform(mVal, mtx);
+	const dx::XMVECTOR scaleSq = dx::XMVectorMax(dx::XMVector3LengthSq(mtx.r[0]),
+		dx::XMVectorMax(dx::XMVector3LengthSq(mtx.r[1]), dx::XMVector3LengthSq(mtx.r[2])));
+	const dx::XMVECTOR radius = dx::XMVectorMultiply(dx::XMVectorSplatW(mVal), dx::XMVectorSqrt(scaleSq));
+
+	sSphere res;
+	res.mVal = dx::XMVectorSelect(center, radius, dx::g_XMSelect0001);
+	return res;
+}
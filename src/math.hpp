@@ -139,3 +139,32 @@ struct sXform {
 	void XM_CALLCONV init(DirectX::FXMMATRIX mtx);
 	DirectX::XMMATRIX XM_CALLCONV build_mtx() const;
 };
+
+// Axis aligned bounding box, w components are ignored
+struct sAABB {
+	DirectX::XMVECTOR mMin;
+	DirectX::XMVECTOR mMax;
+
+	void init_empty();
+	bool is_empty() const;
+	void XM_CALLCONV add(DirectX::FXMVECTOR pos);
+	void add(sAABB const& box);
+	// Box of the affine transformed box, row-vector matrix
+	sAABB XM_CALLCONV transform(DirectX::FXMMATRIX mtx) const;
+
+	DirectX::XMVECTOR get_center() const;
+	DirectX::XMVECTOR get_extents() const;
+};
+
+// Bounding sphere, center in xyz and radius in w
+struct sSphere {
+	DirectX::XMVECTOR mVal;
+
+	// Centered on the box, enclosing the points
+	static sSphere around(sAABB const& box, DirectX::XMFLOAT3 const* pPts, uint32_t const* pIdx, uint32_t num, uint32_t stride);
+	// Sphere of the affine transformed sphere, row-vector matrix. Radius is scaled by the largest axis scale
+	sSphere XM_CALLCONV transform(DirectX::FXMMATRIX mtx) const;
+
+	DirectX::XMVECTOR get_center() const { return mVal; }
+	float get_radius() const { return DirectX::XMVectorGetW(mVal); }
+};
@@ -0,0 +1,326 @@
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "model_src.hpp"
+#include "mesh_lod.hpp"
+
+#include <cassert>
+
+namespace nMeshLod {
+
+// Plane distance quadric, sum of area weighted (n,d)(n,d)^T
+struct sQuadric {
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double w;
+
+	void add(sQuadric const& q) {
+		a00 += q.a00; a01 += q.a01; a02 += q.a02;
+		a11 += q.a11; a12 += q.a12; a22 += q.a22;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		w += q.w;
+	}
+
+	void add_plane(double nx, double ny, double nz, double d, double weight) {
+		a00 += weight * nx * nx; a01 += weight * nx * ny; a02 += weight * nx * nz;
+		a11 += weight * ny * ny; a12 += weight * ny * nz; a22 += weight * nz * nz;
+		b0 += weight * nx * d; b1 += weight * ny * d; b2 += weight * nz * d;
+		c += weight * d * d;
+		w += weight;
+	}
+
+	// Mean squared distance to the planes
+	double eval(vec3 const& p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		const double err =
+			a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z +
+			a11 * y * y + 2.0 * a12 * y * z + a22 * z * z +
+			2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return w > 0.0 ? std::max(err, 0.0) / w : 0.0;
+	}
+};
+
+struct sCollapse {
+	uint32_t mFrom;
+	uint32_t mTo;
+	float mCost;
+};
+
+static vec3 sub(vec3 const& a, vec3 const& b) {
+	return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static vec3 cross(vec3 const& a, vec3 const& b) {
+	return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static float dot(vec3 const& a, vec3 const& b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Sum of weight differences, in [0, 2]
+static float skin_distance(sModelVtx const& a, sModelVtx const& b) {
+	float dist = 0.0f;
+	for (int i = 0; i < 4; ++i) {
+		if (!(a.jwgt[i] > 0.0f)) { continue; }
+		float wb = 0.0f;
+		for (int j = 0; j < 4; ++j) {
+			if (b.jwgt[j] > 0.0f && b.jidx[j] == a.jidx[i]) { wb = b.jwgt[j]; }
+		}
+		dist += std::abs(a.jwgt[i] - wb);
+	}
+	for (int j = 0; j < 4; ++j) {
+		if (!(b.jwgt[j] > 0.0f)) { continue; }
+		bool found = false;
+		for (int i = 0; i < 4; ++i) {
+			found = found || (a.jwgt[i] > 0.0f && a.jidx[i] == b.jidx[j]);
+		}
+		dist += found ? 0.0f : b.jwgt[j];
+	}
+	return dist;
+}
+
+std::vector<uint32_t> simplify(uint32_t const* pIdx, uint32_t idxNum, sModelVtx const* pVtx,
+	uint32_t targetIdx, float& error) {
+
+	error = 0.0f;
+	const uint32_t triNum = idxNum / 3;
+
+	// Local numbering of the vertices referenced by the list
+	std::vector<uint32_t> toGlobal(pIdx, pIdx + triNum * 3);
+	std::sort(toGlobal.begin(), toGlobal.end());
+	toGlobal.erase(std::unique(toGlobal.begin(), toGlobal.end()), toGlobal.end());
+	const uint32_t vtxNum = (uint32_t)toGlobal.size();
+
+	std::vector<uint32_t> idx(triNum * 3);
+	for (uint32_t i = 0; i < triNum * 3; ++i) {
+		idx[i] = (uint32_t)(std::lower_bound(toGlobal.begin(), toGlobal.end(), pIdx[i]) - toGlobal.begin());
+	}
+	auto pos = [&](uint32_t v) -> vec3 const& { return pVtx[toGlobal[v]].pos; };
+
+	// Vertices sharing a position are attribute seams, collapsing them would tear the surface
+	std::vector<bool> locked(vtxNum, false);
+	{
+		std::vector<uint32_t> byPos(vtxNum);
+		std::iota(byPos.begin(), byPos.end(), 0);
+		auto pos_less = [&](uint32_t a, uint32_t b) {
+			vec3 const& pa = pos(a);
+			vec3 const& pb = pos(b);
+			return pa.x < pb.x || (pa.x == pb.x && (pa.y < pb.y || (pa.y == pb.y && pa.z < pb.z)));
+		};
+		std::sort(byPos.begin(), byPos.end(), pos_less);
+		for (uint32_t i = 1; i < vtxNum; ++i) {
+			if (!pos_less(byPos[i - 1], byPos[i])) {
+				locked[byPos[i - 1]] = true;
+				locked[byPos[i]] = true;
+			}
+		}
+	}
+
+	// Edges without an opposite half edge are open borders
+	{
+		std::vector<uint64_t> edges(triNum * 3);
+		for (uint32_t t = 0; t < triNum; ++t) {
+			for (int c = 0; c < 3; ++c) {
+				const uint64_t a = idx[t * 3 + c];
+				const uint64_t b = idx[t * 3 + (c + 1) % 3];
+				edges[t * 3 + c] = (a << 32) | b;
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (uint64_t e : edges) {
+			const uint64_t a = e >> 32;
+			const uint64_t b = e & 0xFFFFFFFFull;
+			if (!std::binary_search(edges.begin(), edges.end(), (b << 32) | a)) {
+				locked[(uint32_t)a] = true;
+				locked[(uint32_t)b] = true;
+			}
+		}
+	}
+
+	std::vector<sQuadric> quadrics(vtxNum, sQuadric{});
+	for (uint32_t t = 0; t < triNum; ++t) {
+		vec3 const& p0 = pos(idx[t * 3 + 0]);
+		const vec3 n = cross(sub(pos(idx[t * 3 + 1]), p0), sub(pos(idx[t * 3 + 2]), p0));
+		const double len = std::sqrt((double)dot(n, n));
+		if (len <= 0.0) { continue; }
+		const double nx = n.x / len, ny = n.y / len, nz = n.z / len;
+		const double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+		for (int c = 0; c < 3; ++c) {
+			quadrics[idx[t * 3 + c]].add_plane(nx, ny, nz, d, len * 0.5);
+		}
+	}
+
+	std::vector<uint32_t> remap(vtxNum);
+	std::vector<uint32_t> touched(vtxNum, 0);
+	std::vector<uint32_t> adjOffset(vtxNum + 1);
+	std::vector<uint32_t> adjTri;
+	std::vector<sCollapse> collapses;
+	double maxErrSq = 0.0;
+	uint32_t pass = 0;
+
+	while (idx.size() > targetIdx) {
+		++pass;
+		const uint32_t curTriNum = (uint32_t)idx.size() / 3;
+
+		std::fill(adjOffset.begin(), adjOffset.end(), 0);
+		for (uint32_t v : idx) { adjOffset[v + 1]++; }
+		std::partial_sum(adjOffset.begin(), adjOffset.end(), adjOffset.begin());
+		adjTri.resize(idx.size());
+		{
+			std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+			for (uint32_t i = 0; i < (uint32_t)idx.size(); ++i) {
+				adjTri[fill[idx[i]]++] = i / 3;
+			}
+		}
+
+		collapses.clear();
+		for (uint32_t t = 0; t < curTriNum; ++t) {
+			for (int c = 0; c < 3; ++c) {
+				const uint32_t a = idx[t * 3 + c];
+				const uint32_t b = idx[t * 3 + (c + 1) % 3];
+				const uint32_t dir[2][2] = { { a, b }, { b, a } };
+				for (auto const& d : dir) {
+					if (locked[d[0]]) { continue; }
+					sQuadric q = quadrics[d[0]];
+					q.add(quadrics[d[1]]);
+					double cost = q.eval(pos(d[1]));
+					const vec3 e = sub(pos(d[0]), pos(d[1]));
+					cost += skin_distance(pVtx[toGlobal[d[0]]], pVtx[toGlobal[d[1]]]) * dot(e, e);
+					collapses.push_back({ d[0], d[1], (float)cost });
+				}
+			}
+		}
+		if (collapses.empty()) { break; }
+		std::sort(collapses.begin(), collapses.end(), [](sCollapse const& a, sCollapse const& b) {
+			return a.mCost < b.mCost;
+		});
+
+		// A collapse removes two triangles of a manifold, collapse neighbourhoods don't overlap within a pass
+		const uint32_t trisToRemove = curTriNum - targetIdx / 3;
+		const uint32_t collapseLimit = std::max(trisToRemove / 2, 1u);
+		std::iota(remap.begin(), remap.end(), 0);
+		uint32_t collapsed = 0;
+
+		for (auto const& col : collapses) {
+			if (touched[col.mFrom] == pass || touched[col.mTo] == pass) { continue; }
+
+			vec3 const& pTo = pos(col.mTo);
+			bool flips = false;
+			for (uint32_t i = adjOffset[col.mFrom]; i < adjOffset[col.mFrom + 1] && !flips; ++i) {
+				uint32_t const* pTri = &idx[adjTri[i] * 3];
+				if (pTri[0] == col.mTo || pTri[1] == col.mTo || pTri[2] == col.mTo) { continue; }
+				vec3 p[3] = { pos(pTri[0]), pos(pTri[1]), pos(pTri[2]) };
+				const vec3 nOld = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+				for (int c = 0; c < 3; ++c) {
+					if (pTri[c] == col.mFrom) { p[c] = pTo; }
+				}
+				const vec3 nNew = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+				flips = dot(nOld, nNew) <= 0.0f;
+			}
+			if (flips) { continue; }
+
+			remap[col.mFrom] = col.mTo;
+			quadrics[col.mTo].add(quadrics[col.mFrom]);
+			maxErrSq = std::max(maxErrSq, (double)col.mCost);
+			for (uint32_t i = adjOffset[col.mFrom]; i < adjOffset[col.mFrom + 1]; ++i) {
+				uint32_t const* pTri = &idx[adjTri[i] * 3];
+				touched[pTri[0]] = touched[pTri[1]] = touched[pTri[2]] = pass;
+			}
+			if (++collapsed >= collapseLimit) { break; }
+		}
+		if (collapsed == 0) { break; }
+
+		uint32_t dst = 0;
+		for (uint32_t t = 0; t < curTriNum; ++t) {
+			const uint32_t a = remap[idx[t * 3 + 0]];
+			const uint32_t b = remap[idx[t * 3 + 1]];
+			const uint32_t c = remap[idx[t * 3 + 2]];
+			if (a == b || b == c || c == a) { continue; }
+			idx[dst++] = a;
+			idx[dst++] = b;
+			idx[dst++] = c;
+		}
+		idx.resize(dst);
+	}
+
+	for (uint32_t& i : idx) {
+		i = toGlobal[i];
+	}
+	error = (float)std::sqrt(maxErrSq);
+	return idx;
+}
+
+sStats build_lods(sModelSrc& src) {
+	sStats stats;
+	if (src.mLodNum == 0) { return stats; }
+
+	// Levels not reducing triangles by this much are not worth a switch
+	const float minReduction = 0.85f;
+	// Groups below this are cheaper to draw than to switch
+	const uint32_t minTris = 64;
+
+	for (auto& grp : src.mGroups) {
+		grp.mLods.clear();
+		const uint32_t fullTris = (uint32_t)grp.mIdx.size() / 3;
+		if (fullTris < minTris) { continue; }
+
+		// Whole group as a single range when not partitioned
+		std::vector<sSkinPart> ranges = grp.mSkinParts;
+		if (ranges.empty()) {
+			ranges.push_back({ 0, (uint32_t)grp.mIdx.size(), 0, 0 });
+		}
+
+		grp.mLods.reserve(src.mLodNum);
+		std::vector<uint32_t> const* pPrevIdx = &grp.mIdx;
+		float prevError = 0.0f;
+		for (uint32_t level = 0; level < src.mLodNum; ++level) {
+			const uint32_t prevTris = (uint32_t)pPrevIdx->size() / 3;
+			sModelSrcLod lod;
+			lod.mError = prevError;
+			lod.mIdx.reserve(pPrevIdx->size() / 2);
+
+			for (auto const& range : ranges) {
+				const uint32_t target = (range.mIdxCount / 6) * 3;
+				float error = 0.0f;
+				auto idx = simplify(&(*pPrevIdx)[range.mIdxStart], range.mIdxCount, src.mVtx.data(), target, error);
+				lod.mError = std::max(lod.mError, error);
+
+				sSkinPart part = range;
+				part.mIdxStart = (uint32_t)lod.mIdx.size();
+				part.mIdxCount = (uint32_t)idx.size();
+				lod.mIdx.insert(lod.mIdx.end(), idx.begin(), idx.end());
+				lod.mSkinParts.push_back(part);
+			}
+
+			const uint32_t lodTris = (uint32_t)lod.mIdx.size() / 3;
+			if (lodTris == 0 || lodTris > prevTris * minReduction) { break; }
+
+			if (grp.mSkinParts.empty()) {
+				lod.mSkinParts.clear();
+			}
+			ranges = lod.mSkinParts.empty() ? std::vector<sSkinPart>{ { 0, (uint32_t)lod.mIdx.size(), 0, 0 } } : lod.mSkinParts;
+			prevError = lod.mError;
+			grp.mLods.push_back(std::move(lod));
+			pPrevIdx = &grp.mLods.back().mIdx;
+		}
+
+		if (!grp.mLods.empty()) {
+			stats.mGroups++;
+			stats.mLods += (uint32_t)grp.mLods.size();
+			stats.mTrisFull += fullTris;
+			stats.mTrisCoarsest += (uint32_t)grp.mLods.back().mIdx.size() / 3;
+		}
+	}
+
+	return stats;
+}
+
+} // namespace nMeshLod
@@ -0,0 +1,24 @@
+struct sModelSrc;
+
+namespace nMeshLod {
+
+struct sStats {
+	uint32_t mGroups = 0;
+	uint32_t mLods = 0;
+	uint32_t mTrisFull = 0;
+	// Triangles of the coarsest levels
+	uint32_t mTrisCoarsest = 0;
+};
+
+// Simplifies a triangle list towards targetIdx indices by quadric error edge collapses.
+// Vertices only collapse into existing ones, so the result indexes the same vertex buffer.
+// Border and attribute seam vertices are locked, joint weight changes add to the cost.
+// error receives the object space distance error of the result.
+std::vector<uint32_t> simplify(uint32_t const* pIdx, uint32_t idxNum, sModelVtx const* pVtx,
+	uint32_t targetIdx, float& error);
+
+// Fills sModelSrcGroup::mLods with up to src.mLodNum levels, halving triangles every level.
+// Skin partitioned groups are simplified per part.
+sStats build_lods(sModelSrc& src);
+
+} // namespace nMeshLod
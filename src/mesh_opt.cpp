@@ -0,0 +1,430 @@
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "model_src.hpp"
+#include "mesh_opt.hpp"
+
+#include <cassert>
+
+namespace nMeshOpt {
+
+struct sFifoCache {
+	static const uint32_t MAX_SIZE = 32;
+
+	uint32_t mVtx[MAX_SIZE];
+	uint32_t mSize;
+	uint32_t mNum = 0;
+	uint32_t mPos = 0;
+
+	explicit sFifoCache(uint32_t size) : mSize(std::min(size, MAX_SIZE)) {}
+
+	void flush() {
+		mNum = 0;
+		mPos = 0;
+	}
+
+	// Returns true on a miss
+	bool access(uint32_t v) {
+		for (uint32_t i = 0; i < mNum; ++i) {
+			if (mVtx[i] == v) { return false; }
+		}
+		if (mNum < mSize) {
+			mVtx[mNum++] = v;
+		} else {
+			mVtx[mPos] = v;
+			mPos = (mPos + 1) % mSize;
+		}
+		return true;
+	}
+
+	uint32_t access_tri(uint32_t const* pTri) {
+		uint32_t misses = 0;
+		for (int i = 0; i < 3; ++i) {
+			misses += access(pTri[i]) ? 1 : 0;
+		}
+		return misses;
+	}
+};
+
+sCacheStats calc_cache_stats(uint32_t const* pIdx, uint32_t idxNum, uint32_t cacheSize) {
+	sCacheStats stats;
+	const uint32_t triNum = idxNum / 3;
+	if (triNum == 0) { return stats; }
+
+	sFifoCache cache(cacheSize);
+	uint32_t misses = 0;
+	for (uint32_t t = 0; t < triNum; ++t) {
+		misses += cache.access_tri(&pIdx[t * 3]);
+	}
+
+	std::vector<uint32_t> uniq(pIdx, pIdx + triNum * 3);
+	std::sort(uniq.begin(), uniq.end());
+	const size_t vtxNum = std::unique(uniq.begin(), uniq.end()) - uniq.begin();
+
+	stats.mACMR = float(misses) / float(triNum);
+	stats.mATVR = float(misses) / float(vtxNum);
+	return stats;
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static const int32_t FORSYTH_CACHE_SIZE = 32;
+
+static float forsyth_vtx_score(int32_t cachePos, uint32_t liveTris) {
+	if (liveTris == 0) { return -1.0f; }
+
+	float score = 0.0f;
+	if (cachePos >= 0) {
+		if (cachePos < 3) {
+			// Fixed score for the last triangle, so it isn't favored for immediate reuse
+			score = 0.75f;
+		} else {
+			const float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePos - 3) * scale, 1.5f);
+		}
+	}
+	// Bonus for vertices with few triangles left, to get rid of lone triangles
+	score += 2.0f / std::sqrt(float(liveTris));
+	return score;
+}
+
+void optimize_vcache(uint32_t* pIdx, uint32_t idxNum, uint32_t vtxNum) {
+	const uint32_t triNum = idxNum / 3;
+	if (triNum < 2) { return; }
+
+	std::vector<uint32_t> liveTris(vtxNum, 0);
+	for (uint32_t i = 0; i < triNum * 3; ++i) {
+		assert(pIdx[i] < vtxNum);
+		liveTris[pIdx[i]]++;
+	}
+
+	// Triangles of every vertex, the first liveTris of each range are not emitted yet
+	std::vector<uint32_t> adjOffset(vtxNum + 1, 0);
+	for (uint32_t v = 0; v < vtxNum; ++v) {
+		adjOffset[v + 1] = adjOffset[v] + liveTris[v];
+	}
+	std::vector<uint32_t> adjTri(triNum * 3);
+	{
+		std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+		for (uint32_t i = 0; i < triNum * 3; ++i) {
+			adjTri[fill[pIdx[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<int32_t> cachePos(vtxNum, -1);
+	std::vector<float> vtxScore(vtxNum);
+	for (uint32_t v = 0; v < vtxNum; ++v) {
+		vtxScore[v] = forsyth_vtx_score(-1, liveTris[v]);
+	}
+
+	std::vector<bool> emitted(triNum, false);
+
+	std::vector<uint32_t> out;
+	out.reserve(triNum * 3);
+
+	// Room for the 3 vertices pushed in before the cache is trimmed
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cacheNum = 0;
+	uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+
+	int64_t bestTri = -1;
+	uint32_t scanPos = 0;
+	for (uint32_t n = 0; n < triNum; ++n) {
+		if (bestTri < 0) {
+			// Nothing adjacent to the cache, restart from the next unemitted triangle in source order
+			while (emitted[scanPos]) { ++scanPos; }
+			bestTri = scanPos;
+		}
+		const uint32_t tri = (uint32_t)bestTri;
+		uint32_t const* pTri = &pIdx[tri * 3];
+		emitted[tri] = true;
+		out.insert(out.end(), pTri, pTri + 3);
+
+		for (int c = 0; c < 3; ++c) {
+			const uint32_t v = pTri[c];
+			uint32_t* pAdj = &adjTri[adjOffset[v]];
+			uint32_t& live = liveTris[v];
+			for (uint32_t i = 0; i < live; ++i) {
+				if (pAdj[i] == tri) {
+					std::swap(pAdj[i], pAdj[live - 1]);
+					--live;
+					break;
+				}
+			}
+		}
+
+		uint32_t newNum = 0;
+		for (int c = 0; c < 3; ++c) {
+			const uint32_t v = pTri[c];
+			if (std::find(newCache, newCache + newNum, v) == newCache + newNum) {
+				newCache[newNum++] = v;
+			}
+		}
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			const uint32_t v = cache[i];
+			if (v != pTri[0] && v != pTri[1] && v != pTri[2]) {
+				newCache[newNum++] = v;
+			}
+		}
+
+		// Evicted vertices lose their cache bonus
+		for (uint32_t i = FORSYTH_CACHE_SIZE; i < newNum; ++i) {
+			const uint32_t v = newCache[i];
+			cachePos[v] = -1;
+			vtxScore[v] = forsyth_vtx_score(-1, liveTris[v]);
+		}
+		cacheNum = std::min(newNum, (uint32_t)FORSYTH_CACHE_SIZE);
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			const uint32_t v = newCache[i];
+			cache[i] = v;
+			cachePos[v] = (int32_t)i;
+			vtxScore[v] = forsyth_vtx_score((int32_t)i, liveTris[v]);
+		}
+
+		// Only triangles touching the cache can become the best one
+		bestTri = -1;
+		float bestScore = -1.0f;
+		for (uint32_t i = 0; i < cacheNum; ++i) {
+			const uint32_t v = cache[i];
+			uint32_t const* pAdj = &adjTri[adjOffset[v]];
+			for (uint32_t j = 0; j < liveTris[v]; ++j) {
+				const uint32_t t = pAdj[j];
+				uint32_t const* pT = &pIdx[t * 3];
+				const float score = vtxScore[pT[0]] + vtxScore[pT[1]] + vtxScore[pT[2]];
+				if (score > bestScore) {
+					bestScore = score;
+					bestTri = t;
+				}
+			}
+		}
+	}
+
+	std::copy(out.begin(), out.end(), pIdx);
+}
+
+struct sCluster {
+	uint32_t mStart;
+	uint32_t mEnd;
+	float mSortKey;
+};
+
+// Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+uint32_t optimize_overdraw(uint32_t* pIdx, uint32_t idxNum, sModelVtx const* pVtx, float threshold) {
+	const uint32_t triNum = idxNum / 3;
+	if (triNum < 2) { return triNum; }
+
+	sFifoCache cache(VCACHE_SIZE);
+
+	// A triangle missing on all of its vertices starts a new patch of the mesh
+	std::vector<uint32_t> hard;
+	for (uint32_t t = 0; t < triNum; ++t) {
+		if (cache.access_tri(&pIdx[t * 3]) == 3 || t == 0) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triNum);
+
+	// Split patches further as long as the running ACMR is good enough
+	std::vector<uint32_t> bounds;
+	for (size_t i = 0; i + 1 < hard.size(); ++i) {
+		const uint32_t start = hard[i];
+		const uint32_t end = hard[i + 1];
+
+		cache.flush();
+		uint32_t misses = 0;
+		for (uint32_t t = start; t < end; ++t) {
+			misses += cache.access_tri(&pIdx[t * 3]);
+		}
+		const float clusterThreshold = threshold * float(misses) / float(end - start);
+
+		cache.flush();
+		bounds.push_back(start);
+		uint32_t runMisses = 0;
+		uint32_t runTris = 0;
+		for (uint32_t t = start; t < end; ++t) {
+			runMisses += cache.access_tri(&pIdx[t * 3]);
+			++runTris;
+			if (float(runMisses) / float(runTris) <= clusterThreshold && t + 1 < end) {
+				bounds.push_back(t + 1);
+				cache.flush();
+				runMisses = 0;
+				runTris = 0;
+			}
+		}
+	}
+	bounds.push_back(triNum);
+
+	namespace dx = DirectX;
+	auto load_pos = [&](uint32_t v) {
+		return dx::XMLoadFloat3((dx::XMFLOAT3 const*)&pVtx[v].pos);
+	};
+
+	dx::XMVECTOR meshCenter = dx::XMVectorZero();
+	float meshArea = 0.0f;
+	std::vector<sCluster> clusters(bounds.size() - 1);
+	std::vector<dx::XMFLOAT3> clusterCenter(clusters.size());
+	std::vector<dx::XMFLOAT3> clusterNrm(clusters.size());
+	for (size_t i = 0; i < clusters.size(); ++i) {
+		auto& cl = clusters[i];
+		cl.mStart = bounds[i];
+		cl.mEnd = bounds[i + 1];
+
+		dx::XMVECTOR center = dx::XMVectorZero();
+		dx::XMVECTOR nrm = dx::XMVectorZero();
+		float area = 0.0f;
+		for (uint32_t t = cl.mStart; t < cl.mEnd; ++t) {
+			const dx::XMVECTOR p0 = load_pos(pIdx[t * 3 + 0]);
+			const dx::XMVECTOR p1 = load_pos(pIdx[t * 3 + 1]);
+			const dx::XMVECTOR p2 = load_pos(pIdx[t * 3 + 2]);
+			const dx::XMVECTOR n = dx::XMVector3Cross(dx::XMVectorSubtract(p1, p0), dx::XMVectorSubtract(p2, p0));
+			const float a = dx::XMVectorGetX(dx::XMVector3Length(n)) * 0.5f;
+			const dx::XMVECTOR sum = dx::XMVectorAdd(dx::XMVectorAdd(p0, p1), p2);
+			center = dx::XMVectorAdd(center, dx::XMVectorScale(sum, a / 3.0f));
+			nrm = dx::XMVectorAdd(nrm, n);
+			area += a;
+		}
+		meshCenter = dx::XMVectorAdd(meshCenter, center);
+		meshArea += area;
+		if (area > 0.0f) {
+			center = dx::XMVectorScale(center, 1.0f / area);
+		}
+		dx::XMStoreFloat3(&clusterCenter[i], center);
+		dx::XMStoreFloat3(&clusterNrm[i], dx::XMVector3Normalize(nrm));
+	}
+	if (meshArea > 0.0f) {
+		meshCenter = dx::XMVectorScale(meshCenter, 1.0f / meshArea);
+	}
+
+	// Clusters facing away from the center are drawn first, they are likely to occlude the others
+	for (size_t i = 0; i < clusters.size(); ++i) {
+		const dx::XMVECTOR dir = dx::XMVectorSubtract(dx::XMLoadFloat3(&clusterCenter[i]), meshCenter);
+		clusters[i].mSortKey = dx::XMVectorGetX(dx::XMVector3Dot(dir, dx::XMLoadFloat3(&clusterNrm[i])));
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](sCluster const& a, sCluster const& b) {
+		return a.mSortKey > b.mSortKey;
+	});
+
+	std::vector<uint32_t> out;
+	out.reserve(triNum * 3);
+	for (auto const& cl : clusters) {
+		out.insert(out.end(), &pIdx[cl.mStart * 3], &pIdx[cl.mEnd * 3]);
+	}
+	std::copy(out.begin(), out.end(), pIdx);
+
+	return (uint32_t)clusters.size();
+}
+
+std::vector<uint32_t> optimize_vfetch(sModelSrc& src) {
+	const uint32_t vtxNum = (uint32_t)src.mVtx.size();
+	std::vector<uint32_t> remap(vtxNum, UINT32_MAX);
+	uint32_t next = 0;
+	for (auto& grp : src.mGroups) {
+		for (uint32_t& idx : grp.mIdx) {
+			if (remap[idx] == UINT32_MAX) {
+				remap[idx] = next++;
+			}
+			idx = remap[idx];
+		}
+		// Simplified levels use a subset of the group vertices
+		for (auto& lod : grp.mLods) {
+			for (uint32_t& idx : lod.mIdx) {
+				idx = remap[idx];
+			}
+		}
+	}
+	for (uint32_t v = 0; v < vtxNum; ++v) {
+		if (remap[v] == UINT32_MAX) {
+			remap[v] = next++;
+		}
+	}
+
+	std::vector<sModelVtx> vtx(vtxNum);
+	for (uint32_t v = 0; v < vtxNum; ++v) {
+		vtx[remap[v]] = src.mVtx[v];
+	}
+	src.mVtx.swap(vtx);
+
+	return remap;
+}
+
+sStats optimize(sModelSrc& src) {
+	sStats stats;
+	uint32_t triTotal = 0;
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+	float atvrBefore = 0.0f;
+	float atvrAfter = 0.0f;
+
+	// Ranges are optimized in local vertex numbering, so working memory depends only on the range size
+	std::vector<uint32_t> toLocal(src.mVtx.size(), UINT32_MAX);
+	std::vector<uint32_t> toGlobal;
+	std::vector<uint32_t> localIdx;
+
+	auto optimize_range = [&](uint32_t* pIdx, uint32_t idxNum) {
+		const uint32_t triNum = idxNum / 3;
+		if (triNum == 0) { return; }
+
+		const auto before = calc_cache_stats(pIdx, idxNum);
+
+		toGlobal.clear();
+		localIdx.resize(idxNum);
+		for (uint32_t i = 0; i < idxNum; ++i) {
+			const uint32_t v = pIdx[i];
+			if (toLocal[v] == UINT32_MAX) {
+				toLocal[v] = (uint32_t)toGlobal.size();
+				toGlobal.push_back(v);
+			}
+			localIdx[i] = toLocal[v];
+		}
+		optimize_vcache(localIdx.data(), idxNum, (uint32_t)toGlobal.size());
+		for (uint32_t i = 0; i < idxNum; ++i) {
+			pIdx[i] = toGlobal[localIdx[i]];
+		}
+		for (uint32_t v : toGlobal) {
+			toLocal[v] = UINT32_MAX;
+		}
+
+		stats.mClusters += optimize_overdraw(pIdx, idxNum, src.mVtx.data(), 1.05f);
+
+		const auto after = calc_cache_stats(pIdx, idxNum);
+		acmrBefore += before.mACMR * triNum;
+		acmrAfter += after.mACMR * triNum;
+		atvrBefore += before.mATVR * triNum;
+		atvrAfter += after.mATVR * triNum;
+		triTotal += triNum;
+	};
+
+	auto optimize_level = [&](std::vector<uint32_t>& idx, std::vector<sSkinPart> const& parts) {
+		if (parts.empty()) {
+			optimize_range(idx.data(), (uint32_t)idx.size());
+		} else {
+			for (auto const& part : parts) {
+				optimize_range(&idx[part.mIdxStart], part.mIdxCount);
+			}
+		}
+	};
+
+	for (auto& grp : src.mGroups) {
+		optimize_level(grp.mIdx, grp.mSkinParts);
+		for (auto& lod : grp.mLods) {
+			optimize_level(lod.mIdx, lod.mSkinParts);
+		}
+	}
+
+	optimize_vfetch(src);
+
+	// Weighted by triangle count
+	if (triTotal) {
+		stats.mBefore.mACMR = acmrBefore / triTotal;
+		stats.mBefore.mATVR = atvrBefore / triTotal;
+		stats.mAfter.mACMR = acmrAfter / triTotal;
+		stats.mAfter.mATVR = atvrAfter / triTotal;
+	}
+	return stats;
+}
+
+} // namespace nMeshOpt
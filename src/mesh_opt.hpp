@@ -0,0 +1,37 @@
+struct sModelSrc;
+
+namespace nMeshOpt {
+
+// Size of the FIFO post-transform cache used to measure index orders
+static const uint32_t VCACHE_SIZE = 16;
+
+struct sCacheStats {
+	float mACMR = 0.0f; // transformed vertices per triangle
+	float mATVR = 0.0f; // transformed vertices per referenced vertex
+};
+
+struct sStats {
+	sCacheStats mBefore;
+	sCacheStats mAfter;
+	uint32_t mClusters = 0;
+};
+
+sCacheStats calc_cache_stats(uint32_t const* pIdx, uint32_t idxNum, uint32_t cacheSize = VCACHE_SIZE);
+
+// Reorders triangles of a list for the post-transform cache (Forsyth).
+// Indices must be lower than vtxNum.
+void optimize_vcache(uint32_t* pIdx, uint32_t idxNum, uint32_t vtxNum);
+
+// Splits a vcache optimized list into clusters at cache flushes and where the local
+// ACMR stays within threshold of the cluster one, then sorts clusters outside-in.
+// Returns the number of clusters.
+uint32_t optimize_overdraw(uint32_t* pIdx, uint32_t idxNum, sModelVtx const* pVtx, float threshold);
+
+// Reorders vertices by first use. Returns old to new vertex index mapping,
+// unreferenced vertices are moved to the end.
+std::vector<uint32_t> optimize_vfetch(sModelSrc& src);
+
+// Runs all of the above on every group and its simplified levels, or skin part of a partitioned group.
+sStats optimize(sModelSrc& src);
+
+} // namespace nMeshOpt
@@ -0,0 +1,190 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "model_src.hpp"
+#include "meshlet.hpp"
+
+#include <cassert>
+
+namespace dx = DirectX;
+
+namespace nMeshlet {
+
+static dx::XMVECTOR load(vec3 const& v) {
+	return dx::XMLoadFloat3((dx::XMFLOAT3 const*)&v);
+}
+
+static void store(vec3& dst, dx::FXMVECTOR v) {
+	dx::XMStoreFloat3((dx::XMFLOAT3*)&dst, v);
+}
+
+static bool is_skinned(sModelSrc const& src, sModelSrcGroup const& grp) {
+	if (!grp.mSkinParts.empty()) { return true; }
+	for (uint32_t idx : grp.mIdx) {
+		if (src.mVtx[idx].jwgt[0] > 0.0f) { return true; }
+	}
+	return false;
+}
+
+static void calc_bounds(sModelSrc const& src, sModelSrcGroup const& grp, sMeshlet& m) {
+	uint32_t const* pIdx = &grp.mIdx[m.mIdxStart];
+
+	sAABB box;
+	box.init_empty();
+	for (uint32_t i = 0; i < m.mIdxCount; ++i) {
+		box.add(load(src.mVtx[pIdx[i]].pos));
+	}
+	const dx::XMVECTOR center = box.get_center();
+	dx::XMVECTOR radiusSq = dx::XMVectorZero();
+	for (uint32_t i = 0; i < m.mIdxCount; ++i) {
+		const dx::XMVECTOR d = dx::XMVectorSubtract(load(src.mVtx[pIdx[i]].pos), center);
+		radiusSq = dx::XMVectorMax(radiusSq, dx::XMVector3LengthSq(d));
+	}
+	store(m.mCenter, center);
+	m.mRadius = dx::XMVectorGetX(dx::XMVectorSqrt(radiusSq));
+
+	const uint32_t triNum = m.mIdxCount / 3;
+	std::vector<dx::XMVECTOR> nrm;
+	nrm.reserve(triNum);
+	dx::XMVECTOR axis = dx::XMVectorZero();
+	for (uint32_t t = 0; t < triNum; ++t) {
+		const dx::XMVECTOR p0 = load(src.mVtx[pIdx[t * 3 + 0]].pos);
+		const dx::XMVECTOR p1 = load(src.mVtx[pIdx[t * 3 + 1]].pos);
+		const dx::XMVECTOR p2 = load(src.mVtx[pIdx[t * 3 + 2]].pos);
+		const dx::XMVECTOR n = dx::XMVector3Cross(dx::XMVectorSubtract(p1, p0), dx::XMVectorSubtract(p2, p0));
+		if (dx::XMVectorGetX(dx::XMVector3LengthSq(n)) <= 0.0f) { continue; }
+		nrm.push_back(dx::XMVector3Normalize(n));
+		axis = dx::XMVectorAdd(axis, nrm.back());
+	}
+
+	m.mConeCutoff = 2.0f;
+	store(m.mConeAxis, dx::XMVectorZero());
+	if (nrm.empty() || dx::XMVectorGetX(dx::XMVector3LengthSq(axis)) <= 0.0f) { return; }
+
+	axis = dx::XMVector3Normalize(axis);
+	float minDot = 1.0f;
+	for (auto const& n : nrm) {
+		minDot = std::min(minDot, dx::XMVectorGetX(dx::XMVector3Dot(n, axis)));
+	}
+	store(m.mConeAxis, axis);
+	if (minDot > 0.0f) {
+		m.mConeCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+sStats build(sModelSrc& src) {
+	sStats stats;
+	std::vector<uint32_t> stamp(src.mVtx.size(), UINT32_MAX);
+	uint32_t meshletId = 0;
+
+	for (auto& grp : src.mGroups) {
+		grp.mMeshlets.clear();
+		if (is_skinned(src, grp)) { continue; }
+
+		const uint32_t triNum = (uint32_t)grp.mIdx.size() / 3;
+		sMeshlet cur = {};
+		uint32_t curVtx = 0;
+		auto flush = [&]() {
+			if (cur.mIdxCount == 0) { return; }
+			calc_bounds(src, grp, cur);
+			grp.mMeshlets.push_back(cur);
+			cur.mIdxStart += cur.mIdxCount;
+			cur.mIdxCount = 0;
+			curVtx = 0;
+			++meshletId;
+		};
+
+		for (uint32_t t = 0; t < triNum; ++t) {
+			uint32_t const* pTri = &grp.mIdx[t * 3];
+			uint32_t newVtx = 0;
+			for (int c = 0; c < 3; ++c) {
+				newVtx += (stamp[pTri[c]] != meshletId) ? 1 : 0;
+			}
+			if (curVtx + newVtx > MAX_VTX || cur.mIdxCount / 3 + 1 > MAX_TRIS) {
+				flush();
+				newVtx = 0;
+				for (int c = 0; c < 3; ++c) {
+					newVtx += (stamp[pTri[c]] != meshletId) ? 1 : 0;
+				}
+			}
+			for (int c = 0; c < 3; ++c) {
+				stamp[pTri[c]] = meshletId;
+			}
+			curVtx += newVtx;
+			cur.mIdxCount += 3;
+		}
+		flush();
+
+		if (!grp.mMeshlets.empty()) {
+			stats.mGroups++;
+			stats.mMeshlets += (uint32_t)grp.mMeshlets.size();
+			stats.mTris += triNum;
+		}
+	}
+
+	return stats;
+}
+
+void XM_CALLCONV sCullView::init(dx::FXMMATRIX world, dx::CXMMATRIX viewProj, dx::FXMVECTOR camPos) {
+	// Planes of the clip space volume, 0 <= z <= w
+	const dx::XMMATRIX cols = dx::XMMatrixTranspose(dx::XMMatrixMultiply(world, viewProj));
+	mPlanes[0] = dx::XMVectorAdd(cols.r[3], cols.r[0]);
+	mPlanes[1] = dx::XMVectorSubtract(cols.r[3], cols.r[0]);
+	mPlanes[2] = dx::XMVectorAdd(cols.r[3], cols.r[1]);
+	mPlanes[3] = dx::XMVectorSubtract(cols.r[3], cols.r[1]);
+	mPlanes[4] = cols.r[2];
+	mPlanes[5] = dx::XMVectorSubtract(cols.r[3], cols.r[2]);
+	for (auto& plane : mPlanes) {
+		plane = dx::XMPlaneNormalize(plane);
+	}
+
+	mCamPos = dx::XMVector3Transform(camPos, dx::XMMatrixInverse(nullptr, world));
+
+	const float len[3] = {
+		dx::XMVectorGetX(dx::XMVector3Length(world.r[0])),
+		dx::XMVectorGetX(dx::XMVector3Length(world.r[1])),
+		dx::XMVectorGetX(dx::XMVector3Length(world.r[2]))
+	};
+	const float tol = 1e-3f * std::max(len[0], std::max(len[1], len[2]));
+	const float ortho = std::abs(dx::XMVectorGetX(dx::XMVector3Dot(world.r[0], world.r[1])))
+		+ std::abs(dx::XMVectorGetX(dx::XMVector3Dot(world.r[1], world.r[2])))
+		+ std::abs(dx::XMVectorGetX(dx::XMVector3Dot(world.r[2], world.r[0])));
+	mCones = std::abs(len[0] - len[1]) <= tol && std::abs(len[1] - len[2]) <= tol && ortho <= tol * len[0];
+}
+
+uint32_t cull(sMeshlet const* pMeshlets, uint32_t num, sCullView const& view, sRange* pRanges) {
+	uint32_t rangesNum = 0;
+	for (uint32_t i = 0; i < num; ++i) {
+		sMeshlet const& m = pMeshlets[i];
+		const dx::XMVECTOR center = load(m.mCenter);
+		const dx::XMVECTOR negRadius = dx::XMVectorReplicate(-m.mRadius);
+
+		dx::XMVECTOR outside = dx::XMVectorFalseInt();
+		for (auto const& plane : view.mPlanes) {
+			outside = dx::XMVectorOrInt(outside, dx::XMVectorLess(dx::XMPlaneDotCoord(plane, center), negRadius));
+		}
+		if (dx::XMVectorGetIntX(outside)) { continue; }
+
+		// All triangles face away when the view direction to any point of the
+		// sphere is within 90 degrees minus the cone spread of the axis
+		if (view.mCones && m.mConeCutoff <= 1.0f) {
+			const dx::XMVECTOR dir = dx::XMVectorSubtract(center, view.mCamPos);
+			const float dist = dx::XMVectorGetX(dx::XMVector3Length(dir));
+			const float proj = dx::XMVectorGetX(dx::XMVector3Dot(dir, load(m.mConeAxis)));
+			if (proj >= m.mConeCutoff * (dist + m.mRadius) + m.mRadius) { continue; }
+		}
+
+		if (rangesNum && pRanges[rangesNum - 1].mIdxStart + pRanges[rangesNum - 1].mIdxCount == m.mIdxStart) {
+			pRanges[rangesNum - 1].mIdxCount += m.mIdxCount;
+		} else {
+			pRanges[rangesNum++] = { m.mIdxStart, m.mIdxCount };
+		}
+	}
+	return rangesNum;
+}
+
+} // namespace nMeshlet
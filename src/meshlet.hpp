@@ -0,0 +1,40 @@
+struct sModelSrc;
+struct sMeshlet;
+
+namespace nMeshlet {
+
+static const uint32_t MAX_VTX = 64;
+static const uint32_t MAX_TRIS = 124;
+
+struct sStats {
+	uint32_t mGroups = 0;
+	uint32_t mMeshlets = 0;
+	uint32_t mTris = 0;
+};
+
+// Splits the final triangle order of every not skinned group into meshlets, without reordering.
+// Skinned groups deform away from bind pose bounds and are left whole.
+sStats build(sModelSrc& src);
+
+// Model space view of a frame
+struct sCullView {
+	// Normalized planes facing inside: left, right, bottom, top, near, far
+	DirectX::XMVECTOR mPlanes[6];
+	DirectX::XMVECTOR mCamPos;
+	// Cones are only valid under rotation and uniform scale
+	bool mCones;
+
+	void XM_CALLCONV init(DirectX::FXMMATRIX world, DirectX::CXMMATRIX viewProj, DirectX::FXMVECTOR camPos);
+};
+
+// Index range of consecutive visible meshlets, relative to the group start
+struct sRange {
+	uint32_t mIdxStart;
+	uint32_t mIdxCount;
+};
+
+// Frustum and backface cone culling, adjacent visible meshlets are merged.
+// pRanges must hold num entries, returns the number written.
+uint32_t cull(sMeshlet const* pMeshlets, uint32_t num, sCullView const& view, sRange* pRanges);
+
+} // namespace nMeshlet
@@ -4,12 +4,26 @@
 #include "gfx.hpp"
 #include "path_helpers.hpp"
 #include "texture.hpp"
+#include "model_src.hpp"
+#include "vtx_weld.hpp"
+#include "skin_partition.hpp"
+#include "mesh_lod.hpp"
+#include "meshlet.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "tri_bvh.hpp"
+#include "tri_sort.hpp"
+#include "mesh_opt.hpp"
+#include "skin.hpp"
+#include "vtx_fmt.hpp"
 #include "model.hpp"
+#include "rig.hpp"
 #include "hou_geo.hpp"
 #include "path_helpers.hpp"
 #include "assimp_loader.hpp"
 #include "imgui.hpp"
 #include "rdr_queue.hpp"
+#include "parallel.hpp"
 
 CLANG_DIAG_PUSH
 CLANG_DIAG_IGNORE("-Wpragma-pack")
@@ -18,9 +32,13 @@ CLANG_DIAG_IGNORE("-Wpragma-pack")
 CLANG_DIAG_POP
 
 #include <cassert>
+#include <chrono>
 
 
 
+// Vertices or triangles converted by one task of the importers
+static const uint32_t IMPORT_GRAIN = 16 * 1024;
+
 static vec4 as_vec4_1(aiVector3D const& v) {
 	return { { v.x, v.y, v.z, 1.0f } };
 }
@@ -98,21 +116,11 @@ bool cModelData::load_hou_geo(const fs::path& filepath) {
 		return false;
 
 	int numVtx = geo.mPointCount;
-	int numIdx = geo.mVertexCount;
 	int numGrp = geo.mNonemptyGroups;
 
-	auto pGroups = std::make_unique<sGroup[]>(numGrp);
-	auto pVtx = std::make_unique<sModelVtx[]>(numVtx);
-	auto pIdx = std::make_unique<uint16_t[]>(numIdx);
-	auto pNames = std::make_unique<std::string[]>(numGrp);
-
-	const uint32_t vtxSize = sizeof(sModelVtx);
-	const DXGI_FORMAT idxFormat = DXGI_FORMAT_R16_UINT;
-
-	auto pVtxItr = pVtx.get();
-	auto pIdxItr = pIdx.get();
-	auto pGrpItr = pGroups.get();
-	auto pNamesItr = pNames.get();
+	sModelSrc src;
+	src.mVtx.resize(numVtx);
+	src.mGroups.reserve(numGrp);
 
 	cHouGeoAttrib const* pPosAttr = nullptr;
 	cHouGeoAttrib const* pNrmAttr = nullptr;
@@ -155,62 +163,79 @@ bool cModelData::load_hou_geo(const fs::path& filepath) {
 		}
 	}
 
-	for (int vtx = 0; vtx < numVtx; ++vtx) {
-		pVtxItr->pos = as_vec3(pPosAttr, vtx);
-		pVtxItr->nrm = as_vec3(pNrmAttr, vtx);
-		pVtxItr->uv = as_vec2f(pUVAttr, vtx);
-		pVtxItr->uv.y = -pVtxItr->uv.y;
-		pVtxItr->tgt = as_vec4(pTngUAttr, vtx);
-		pVtxItr->bitgt = as_vec3(pTngVAttr, vtx);
-		pVtxItr->uv1 = as_vec2f(pUV1Attr, vtx);
-		pVtxItr->uv1.y = -pVtxItr->uv1.y;
-		pVtxItr->clr = as_vec3(pCdAttr, vtx);
-		pVtxItr->jidx = as_vec4i(pJIdxAttr, vtx);
-		pVtxItr->jwgt = as_vec4(pJWgtAttr, vtx);
-		++pVtxItr;
-	}
+	const auto start = std::chrono::steady_clock::now();
+
+	auto pVtx = src.mVtx.data();
+	nParallel::for_ranges((uint32_t)numVtx, IMPORT_GRAIN, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			const int vtx = (int)i;
+			auto& v = pVtx[i];
+			v.pos = as_vec3(pPosAttr, vtx);
+			v.nrm = as_vec3(pNrmAttr, vtx);
+			v.uv = as_vec2f(pUVAttr, vtx);
+			v.uv.y = -v.uv.y;
+			v.tgt = as_vec4(pTngUAttr, vtx);
+			v.bitgt = as_vec3(pTngVAttr, vtx);
+			v.uv1 = as_vec2f(pUV1Attr, vtx);
+			v.uv1.y = -v.uv1.y;
+			v.clr = as_vec3(pCdAttr, vtx);
+			v.jidx = as_vec4i(pJIdxAttr, vtx);
+			v.jwgt = as_vec4(pJWgtAttr, vtx);
+		}
+	});
 
 	auto const& poly = geo.mPoly;
 	auto const vmap = geo.mpVertexMap.get();
 
+	// Valid triangles are counted per chunk of the intervals,
+	// prefix sums of the counts place the chunks in the group indices
+	std::vector<uint32_t> ivSizes;
+	std::vector<uint32_t> chunkOffsets;
 	for (int igrp = 0; igrp < geo.mGroupsCount; ++igrp) {
 		auto const& grp = geo.mpGroups[igrp];
 		if (grp.mEmpty) { continue; }
 
-		auto pIdxGrpStart = pIdxItr;
+		src.mGroups.emplace_back();
+		auto& srcGrp = src.mGroups.back();
+		srcGrp.mName = grp.mName;
 
+		ivSizes.resize(grp.mIntervalsCount);
 		for (int i = 0; i < grp.mIntervalsCount; ++i) {
 			auto const& iv = grp.mpIntervals[i];
-			for (int j = iv.start; j < iv.end; ++j) {
-				if (!poly[j].valid) continue;
+			ivSizes[i] = (uint32_t)std::max(iv.end - iv.start, 0);
+		}
+		const auto chunks = nParallel::split_chunks(ivSizes.data(), (uint32_t)ivSizes.size(), IMPORT_GRAIN);
+
+		chunkOffsets.assign(chunks.size() + 1, 0);
+		nParallel::for_chunks(chunks, [&](uint32_t ci, nParallel::sChunk const& chunk) {
+			const int first = grp.mpIntervals[chunk.mItem].start;
+			uint32_t count = 0;
+			for (uint32_t j = chunk.mBegin; j < chunk.mEnd; ++j) {
+				count += poly[first + j].valid ? 1 : 0;
+			}
+			chunkOffsets[ci + 1] = count;
+		});
+		std::inclusive_scan(chunkOffsets.begin(), chunkOffsets.end(), chunkOffsets.begin());
+
+		srcGrp.mIdx.resize(size_t(chunkOffsets.back()) * 3);
+		uint32_t* pGrpIdx = srcGrp.mIdx.data();
+		nParallel::for_chunks(chunks, [&](uint32_t ci, nParallel::sChunk const& chunk) {
+			const int first = grp.mpIntervals[chunk.mItem].start;
+			uint32_t* pIdx = pGrpIdx + size_t(chunkOffsets[ci]) * 3;
+			for (uint32_t j = chunk.mBegin; j < chunk.mEnd; ++j) {
+				auto const& p = poly[first + j];
+				if (!p.valid) continue;
 				for (int k = 0; k < 3; ++k) {
-					int pidx = poly[j].v[k];
-					*pIdxItr = (uint16_t)vmap[pidx];
-					pIdxItr++;
+					*pIdx++ = (uint32_t)vmap[p.v[k]];
 				}
 			}
-		}
-
-		pGrpItr->mPolyType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		pGrpItr->mVtxOffset = 0;
-		pGrpItr->mIdxCount = static_cast<uint32_t>((pIdxItr - pIdxGrpStart));
-		pGrpItr->mIdxOffset = static_cast<uint32_t>((pIdxGrpStart - pIdx.get()) * sizeof(pIdxGrpStart[0]));
-		
-		*pNamesItr = grp.mName;
-
-		++pGrpItr;
-		++pNamesItr;
+		});
 	}
 
-	auto pDev = get_gfx().get_dev();
-	mVtx.init(pDev, pVtx.get(), numVtx, vtxSize);
-	mIdx.init(pDev, pIdx.get(), numIdx, idxFormat);
+	dbg_msg("model: converted %d vertices, %d groups in %.1f ms\n", numVtx, (int)src.mGroups.size(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 
-	mGrpNum = numGrp;
-	mpGroups = std::move(pGroups);
-	mpGrpNames = std::move(pNames);
-
-	return true;
+	return init(src);
 }
 
 template <typename T>
@@ -218,9 +243,9 @@ struct sReadItr {
 	T const* mpItr;
 	int mStep;
 
-	sReadItr(T const* p, T const* pDef) {
+	sReadItr(T const* p, T const* pDef, uint32_t first = 0) {
 		if (p) {
-			mpItr = p;
+			mpItr = p + first;
 			mStep = 1;
 		} else {
 			mpItr = pDef;
@@ -249,32 +274,35 @@ bool cModelData::load_assimp(cAssimpLoader& loader) {
 	int numGrp = (int)meshes.size();
 	if (numGrp == 0) { return false; }
 
-	int numVtx = 0;
-	int numIdx = 0;
-
-	for (auto& mi : meshes) {
-		aiMesh* pMesh = mi.mpMesh;
-
+	// Vertex offsets of the meshes are prefix sums of their sizes
+	std::vector<uint32_t> vtxBase(numGrp);
+	std::vector<uint32_t> meshVtx(numGrp);
+	std::vector<uint32_t> meshFace(numGrp);
+	uint32_t numVtx = 0;
+	for (int i = 0; i < numGrp; ++i) {
+		aiMesh const* pMesh = meshes[i].mpMesh;
+		vtxBase[i] = numVtx;
+		meshVtx[i] = pMesh->mNumVertices;
+		meshFace[i] = pMesh->mNumFaces;
 		numVtx += pMesh->mNumVertices;
-
-		int idx = pMesh->mNumFaces;
-		numIdx += idx * 3;
 	}
 	
 	auto bonesMap = loader.get_bones_map();
 
-	auto pGroups = std::make_unique<sGroup[]>(numGrp);
-	auto pVtx = std::make_unique<sModelVtx[]>(numVtx);
-	auto pIdx = std::make_unique<uint16_t[]>(numIdx);
-	auto pNames = std::make_unique<std::string[]>(numGrp);
-
-	const uint32_t vtxSize = sizeof(sModelVtx);
-	const DXGI_FORMAT idxFormat = DXGI_FORMAT_R16_UINT;
+	sModelSrc src;
+	src.mVtx.resize(numVtx);
+	src.mGroups.resize(numGrp);
+	for (int i = 0; i < numGrp; ++i) {
+		auto& mi = meshes[i];
+		src.mGroups[i].mIdx.resize(size_t(meshFace[i]) * 3);
+		if (mi.mName.starts_with("g ")) {
+			src.mGroups[i].mName = &mi.mName.p[2];
+		} else {
+			src.mGroups[i].mName = mi.mName;
+		}
+	}
 
-	auto pVtxItr = pVtx.get();
-	auto pIdxItr = pIdx.get();
-	auto pGrpItr = pGroups.get();
-	auto pNamesItr = pNames.get();
+	const auto start = std::chrono::steady_clock::now();
 
 	const aiColor4D defColor = { 1.0f, 1.0f, 1.0f, 1.0f };
 	const aiVector3D defV3Zero = { 0.0f, 0.0f, 0.0f };
@@ -282,23 +310,21 @@ bool cModelData::load_assimp(cAssimpLoader& loader) {
 	const aiVector3D defBitgt = { 0.0f, 1.0f, 0.0f };
 	const aiVector3D defNrm = { 0.0f, 0.0f, 1.0f };
 
-	for (auto& mi : meshes) {
-		aiMesh* pMesh = mi.mpMesh;
-
-		auto pVtxGrpStart = pVtxItr;
-		auto pIdxGrpStart = pIdxItr;
+	// Vertex and face ranges of all meshes are converted in parallel
+	const auto vtxChunks = nParallel::split_chunks(meshVtx.data(), numGrp, IMPORT_GRAIN);
+	nParallel::for_chunks(vtxChunks, [&](uint32_t, nParallel::sChunk const& chunk) {
+		aiMesh const* pMesh = meshes[chunk.mItem].mpMesh;
 
-		const int meshVtx = pMesh->mNumVertices;
-
-		sReadItr<aiVector3D> posItr(pMesh->mVertices, &defV3Zero);
-		sReadItr<aiVector3D> nrmItr(pMesh->mNormals, &defNrm);
-		sReadItr<aiVector3D> uvItr(pMesh->mTextureCoords[0], &defV3Zero);
+		sReadItr<aiVector3D> posItr(pMesh->mVertices, &defV3Zero, chunk.mBegin);
+		sReadItr<aiVector3D> nrmItr(pMesh->mNormals, &defNrm, chunk.mBegin);
+		sReadItr<aiVector3D> uvItr(pMesh->mTextureCoords[0], &defV3Zero, chunk.mBegin);
 		sReadItr<aiVector3D> tgtItr(nullptr, &defTgt);
 		sReadItr<aiVector3D> bitgtItr(nullptr, &defBitgt);
 		sReadItr<aiVector3D> uv1Itr(nullptr, &defV3Zero);
-		sReadItr<aiColor4D> clrItr(pMesh->mColors[0], &defColor);
+		sReadItr<aiColor4D> clrItr(pMesh->mColors[0], &defColor, chunk.mBegin);
 
-		for (int vtx = 0; vtx < meshVtx; ++vtx) {
+		auto pVtxItr = src.mVtx.data() + vtxBase[chunk.mItem] + chunk.mBegin;
+		for (uint32_t vtx = chunk.mBegin; vtx < chunk.mEnd; ++vtx) {
 			pVtxItr->pos = as_vec3(posItr.read());
 			pVtxItr->nrm = as_vec3(nrmItr.read());
 			pVtxItr->uv = as_vec2f(uvItr.read());
@@ -311,76 +337,461 @@ bool cModelData::load_assimp(cAssimpLoader& loader) {
 			::memset(&pVtxItr->jwgt, 0, sizeof(pVtxItr->jwgt));
 			++pVtxItr;
 		}
-
-		const int meshFace = pMesh->mNumFaces;
-		aiFace const* pFace = pMesh->mFaces;
-		for (int face = 0; face < meshFace; ++face) {
+	});
+
+	const auto faceChunks = nParallel::split_chunks(meshFace.data(), numGrp, IMPORT_GRAIN);
+	nParallel::for_chunks(faceChunks, [&](uint32_t, nParallel::sChunk const& chunk) {
+		aiMesh const* pMesh = meshes[chunk.mItem].mpMesh;
+		const uint32_t base = vtxBase[chunk.mItem];
+		auto pIdxItr = src.mGroups[chunk.mItem].mIdx.data() + size_t(chunk.mBegin) * 3;
+		aiFace const* pFace = pMesh->mFaces + chunk.mBegin;
+		for (uint32_t face = chunk.mBegin; face < chunk.mEnd; ++face) {
 			assert(pFace->mNumIndices == 3);
-			pIdxItr[0] = pFace->mIndices[0];
-			pIdxItr[1] = pFace->mIndices[1];
-			pIdxItr[2] = pFace->mIndices[2];
+			pIdxItr[0] = base + pFace->mIndices[0];
+			pIdxItr[1] = base + pFace->mIndices[1];
+			pIdxItr[2] = base + pFace->mIndices[2];
 
 			pIdxItr += 3;
 			++pFace;
 		}
+	});
+
+	// Influence slots are taken in bone order, so bones of a mesh stay serial
+	nParallel::for_ranges((uint32_t)numGrp, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t mesh = begin; mesh < end; ++mesh) {
+			aiMesh const* pMesh = meshes[mesh].mpMesh;
+			sModelVtx* pVtxGrpStart = src.mVtx.data() + vtxBase[mesh];
+			for (uint32_t bone = 0; bone < pMesh->mNumBones; ++bone) {
+				auto pBone = pMesh->mBones[bone];
+				auto bIt = bonesMap.find(pBone->mName.C_Str());
+				if (bIt == bonesMap.end()) { continue; }
+
+				int32_t boneIdx = bIt->second;
+
+				auto w = pBone->mWeights;
+				for (uint32_t i = 0; i < pBone->mNumWeights; ++i) {
+					auto vidx = w[i].mVertexId;
+					auto jwgt = w[i].mWeight;
+
+					auto& vtx = pVtxGrpStart[vidx];
+					for (int j = 0; j < 4; ++j) {
+						if (vtx.jwgt[j] == 0.0f) {
+							vtx.jwgt[j] = jwgt;
+							vtx.jidx[j] = boneIdx;
+							break;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	dbg_msg("model: converted %u vertices, %d groups in %.1f ms\n", numVtx, numGrp,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 
-		
-		for (uint32_t bone = 0; bone < pMesh->mNumBones; ++bone) {
-			auto pBone = pMesh->mBones[bone];
-			auto bIt = bonesMap.find(pBone->mName.C_Str());
-			if (bIt == bonesMap.end()) { continue; }
+	return init(src);
+}
 
-			int32_t boneIdx = bIt->second;
+// Skin partitioning leaves part-local joint indices in the vertices,
+// CPU skinning needs the global ones back.
+static std::unique_ptr<sSkinVtx[]> build_skin_vtx(sModelSrc const& src) {
+	const uint32_t vtxNum = (uint32_t)src.mVtx.size();
+	bool isSkinned = false;
+	for (uint32_t i = 0; i < vtxNum && !isSkinned; ++i) {
+		isSkinned = src.mVtx[i].jwgt[0] > 0.0f;
+	}
+	if (!isSkinned) { return nullptr; }
+
+	auto pSkinVtx = std::make_unique<sSkinVtx[]>(vtxNum);
+	for (uint32_t i = 0; i < vtxNum; ++i) {
+		auto const& vtx = src.mVtx[i];
+		auto& skinVtx = pSkinVtx[i];
+		::memcpy(skinVtx.pos, &vtx.pos, sizeof(skinVtx.pos));
+		::memcpy(skinVtx.nrm, &vtx.nrm, sizeof(skinVtx.nrm));
+		::memcpy(skinVtx.tgt, &vtx.tgt, sizeof(skinVtx.tgt));
+		for (int j = 0; j < 4; ++j) {
+			const bool used = vtx.jwgt[j] > 0.0f;
+			skinVtx.jwgt[j] = used ? vtx.jwgt[j] : 0.0f;
+			skinVtx.jidx[j] = used ? vtx.jidx[j] : 0;
+		}
+	}
 
-			auto w = pBone->mWeights;
-			for (uint32_t i = 0; i < pBone->mNumWeights; ++i) {
-				auto vidx = w[i].mVertexId;
-				auto jwgt = w[i].mWeight;
-				
-				auto& vtx = pVtxGrpStart[vidx];
+	// Every partitioned vertex belongs to a single part
+	std::vector<bool> remapped(vtxNum);
+	for (auto const& grp : src.mGroups) {
+		for (auto const& part : grp.mSkinParts) {
+			uint16_t const* pJnt = &grp.mSkinJnt[part.mJntOffset];
+			for (uint32_t i = 0; i < part.mIdxCount; ++i) {
+				const uint32_t v = grp.mIdx[part.mIdxStart + i];
+				if (remapped[v]) { continue; }
+				remapped[v] = true;
+				auto& skinVtx = pSkinVtx[v];
 				for (int j = 0; j < 4; ++j) {
-					if (vtx.jwgt[j] == 0.0f) {
-						vtx.jwgt[j] = jwgt;
-						vtx.jidx[j] = boneIdx;
-						break;
-					}
+					skinVtx.jidx[j] = (skinVtx.jwgt[j] > 0.0f) ? pJnt[skinVtx.jidx[j]] : 0;
 				}
 			}
 		}
+	}
 
+	return pSkinVtx;
+}
 
-		pGrpItr->mVtxOffset = static_cast<uint32_t>((pVtxGrpStart - pVtx.get()) * sizeof(pVtxGrpStart[0]));
-		pGrpItr->mIdxCount = static_cast<uint32_t>((pIdxItr - pIdxGrpStart));
-		pGrpItr->mIdxOffset = static_cast<uint32_t>((pIdxGrpStart - pIdx.get()) * sizeof(pIdxGrpStart[0]));
-		pGrpItr->mPolyType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+static void build_skin_bounds(sSkinVtx const* pSkinVtx, uint32_t vtxNum, uint32_t& boundsNum, std::unique_ptr<sAABB[]>& pBounds) {
+	int32_t jntNum = 0;
+	for (uint32_t i = 0; i < vtxNum; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			jntNum = std::max(jntNum, pSkinVtx[i].jidx[j] + 1);
+		}
+	}
 
-		if (mi.mName.starts_with("g ")) {
-			*pNamesItr = &mi.mName.p[2];
+	pBounds = std::make_unique<sAABB[]>(jntNum);
+	for (int32_t i = 0; i < jntNum; ++i) {
+		pBounds[i].init_empty();
+	}
+	for (uint32_t i = 0; i < vtxNum; ++i) {
+		auto const& vtx = pSkinVtx[i];
+		const DirectX::XMVECTOR pos = DirectX::XMLoadFloat3((DirectX::XMFLOAT3 const*)vtx.pos);
+		for (int j = 0; j < 4; ++j) {
+			if (vtx.jwgt[j] > 0.0f) {
+				pBounds[vtx.jidx[j]].add(pos);
+			}
+		}
+	}
+	boundsNum = (uint32_t)jntNum;
+}
+
+// Bounds of the vertices referenced by every group, and of all vertices
+static void build_bounds(sModelSrc const& src, sAABB* pGrpBounds, sSphere* pGrpSpheres, sAABB& bounds, sSphere& sphere) {
+	auto pPos = reinterpret_cast<DirectX::XMFLOAT3 const*>(&src.mVtx[0].pos);
+	const uint32_t stride = sizeof(sModelVtx);
+
+	for (size_t i = 0; i < src.mGroups.size(); ++i) {
+		auto const& grp = src.mGroups[i];
+		sAABB& box = pGrpBounds[i];
+		box.init_empty();
+		for (uint32_t idx : grp.mIdx) {
+			box.add(DirectX::XMLoadFloat3((DirectX::XMFLOAT3 const*)&src.mVtx[idx].pos));
+		}
+		pGrpSpheres[i] = sSphere::around(box, pPos, grp.mIdx.data(), (uint32_t)grp.mIdx.size(), stride);
+	}
+	bounds.init_empty();
+	for (auto const& vtx : src.mVtx) {
+		bounds.add(DirectX::XMLoadFloat3((DirectX::XMFLOAT3 const*)&vtx.pos));
+	}
+	sphere = sSphere::around(bounds, pPos, nullptr, (uint32_t)src.mVtx.size(), stride);
+}
+
+bool cModelData::init(sModelSrc& src) {
+	const auto weldStats = nVtxWeld::weld(src);
+	if (weldStats.mVtxAfter != weldStats.mVtxBefore) {
+		dbg_msg("model: welded %u -> %u vertices (%.1f KB -> %.1f KB)\n",
+			weldStats.mVtxBefore, weldStats.mVtxAfter,
+			weldStats.mVtxBefore * sizeof(sModelVtx) / 1024.0f, weldStats.mVtxAfter * sizeof(sModelVtx) / 1024.0f);
+		for (size_t i = 0; i < weldStats.mGroups.size(); ++i) {
+			auto const& grpStats = weldStats.mGroups[i];
+			dbg_msg("model:   %s: %u -> %u vertices, %.1f KB less\n", src.mGroups[i].mName.c_str(),
+				grpStats.mVtxBefore, grpStats.mVtxAfter,
+				(grpStats.mVtxBefore - grpStats.mVtxAfter) * sizeof(sModelVtx) / 1024.0f);
+		}
+	}
+
+	const auto partStats = nSkinPartition::partition(src,
+		std::min((uint32_t)sSkinCBuf::MAX_SKIN_MTX, (uint32_t)sSkinDQCBuf::MAX_SKIN_DQ));
+	if (partStats.mGroups) {
+		dbg_msg("model: %u skinned groups split into %u parts, %u vertices duplicated\n",
+			partStats.mGroups, partStats.mParts, partStats.mDupVtx);
+	}
+
+	const int numVtx = (int)src.mVtx.size();
+	const int numGrp = (int)src.mGroups.size();
+	if (numVtx == 0 || numGrp == 0) { return false; }
+
+	const auto lodStats = nMeshLod::build_lods(src);
+	if (lodStats.mGroups) {
+		dbg_msg("model: %u levels for %u groups, %u -> %u triangles at the coarsest\n",
+			lodStats.mLods, lodStats.mGroups, lodStats.mTrisFull, lodStats.mTrisCoarsest);
+	}
+
+	const auto optStats = nMeshOpt::optimize(src);
+	dbg_msg("model: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u overdraw clusters\n",
+		optStats.mBefore.mACMR, optStats.mAfter.mACMR,
+		optStats.mBefore.mATVR, optStats.mAfter.mATVR, optStats.mClusters);
+
+	const auto meshletStats = nMeshlet::build(src);
+	if (meshletStats.mGroups) {
+		dbg_msg("model: %u meshlets in %u groups, %.1f triangles per meshlet\n",
+			meshletStats.mMeshlets, meshletStats.mGroups, float(meshletStats.mTris) / meshletStats.mMeshlets);
+	}
+
+	auto pGrpBounds = std::make_unique<sAABB[]>(numGrp);
+	auto pGrpSpheres = std::make_unique<sSphere[]>(numGrp);
+	sAABB bounds;
+	sSphere sphere;
+	build_bounds(src, pGrpBounds.get(), pGrpSpheres.get(), bounds, sphere);
+
+	if (src.mBvh) {
+		mBvh.build(src);
+		auto const& bvhStats = mBvh.get_stats();
+		dbg_msg("model: BVH of %u triangles, %u nodes, %u leaves, depth %u, built in %.1f ms\n",
+			bvhStats.mTris, bvhStats.mNodes, bvhStats.mLeaves, bvhStats.mDepth, bvhStats.mBuildSeconds * 1000.0);
+	} else {
+		mBvh.clear();
+	}
+
+	uint32_t numParts = 0;
+	uint32_t numSkinJnt = 0;
+	uint32_t numLods = 0;
+	uint32_t numMeshlets = 0;
+	uint32_t grpMeshletsMax = 0;
+	for (auto const& grp : src.mGroups) {
+		numParts += (uint32_t)grp.mSkinParts.size() * (1 + (uint32_t)grp.mLods.size());
+		numSkinJnt += (uint32_t)grp.mSkinJnt.size();
+		numLods += (uint32_t)grp.mLods.size();
+		numMeshlets += (uint32_t)grp.mMeshlets.size();
+		grpMeshletsMax = std::max(grpMeshletsMax, (uint32_t)grp.mMeshlets.size());
+	}
+
+	auto pGroups = std::make_unique<sGroup[]>(numGrp);
+	auto pNames = std::make_unique<std::string[]>(numGrp);
+	auto pSkinParts = numParts ? std::make_unique<sSkinPart[]>(numParts) : nullptr;
+	auto pSkinJnt = numSkinJnt ? std::make_unique<uint16_t[]>(numSkinJnt) : nullptr;
+	auto pLods = numLods ? std::make_unique<sGroupLod[]>(numLods) : nullptr;
+	auto pMeshlets = numMeshlets ? std::make_unique<sMeshlet[]>(numMeshlets) : nullptr;
+
+	// Indices are relative to the lowest vertex of the group, which is passed as
+	// the base vertex of the draw. Groups spanning more than 64K vertices use 32 bit indices.
+	// Simplified levels follow their group, with the same format and base vertex.
+	uint32_t idxUnits = 0;
+	uint32_t numIdx32 = 0;
+	uint32_t lodOffset = 0;
+	for (int i = 0; i < numGrp; ++i) {
+		auto const& srcGrp = src.mGroups[i];
+		auto& grp = pGroups[i];
+
+		uint32_t vtxMin = 0;
+		uint32_t vtxMax = 0;
+		if (!srcGrp.mIdx.empty()) {
+			auto mm = std::minmax_element(srcGrp.mIdx.begin(), srcGrp.mIdx.end());
+			vtxMin = *mm.first;
+			vtxMax = *mm.second;
+		}
+		const bool is32 = vtxMax - vtxMin > 0xFFFF;
+		const uint32_t unitsPerIdx = is32 ? 2 : 1;
+		if (is32) {
+			// 4 byte alignment of the offset
+			idxUnits = (idxUnits + 1) & ~1u;
+			numIdx32 += (uint32_t)srcGrp.mIdx.size();
+		}
+
+		grp.mBaseVtx = vtxMin;
+		grp.mIdxFormat = is32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+		grp.mIdxOffset = idxUnits * sizeof(uint16_t);
+		grp.mIdxCount = (uint32_t)srcGrp.mIdx.size();
+		idxUnits += grp.mIdxCount * unitsPerIdx;
+
+		grp.mLodOffset = lodOffset;
+		grp.mLodNum = (uint32_t)srcGrp.mLods.size();
+		for (auto const& srcLod : srcGrp.mLods) {
+			auto& lod = pLods[lodOffset++];
+			lod.mIdxOffset = idxUnits * sizeof(uint16_t);
+			lod.mIdxCount = (uint32_t)srcLod.mIdx.size();
+			lod.mError = srcLod.mError;
+			idxUnits += lod.mIdxCount * unitsPerIdx;
+		}
+	}
+	if (numIdx32) {
+		dbg_msg("model: %u indices stored as 32 bit\n", numIdx32);
+	}
+
+	auto pIdx = std::make_unique<uint16_t[]>(std::max(idxUnits, 1u));
+
+	auto write_idx = [&](sGroup const& grp, uint32_t offset, std::vector<uint32_t> const& idx) {
+		uint16_t* pIdxGrp = &pIdx[offset / sizeof(uint16_t)];
+		const uint32_t count = (uint32_t)idx.size();
+		if (grp.mIdxFormat == DXGI_FORMAT_R32_UINT) {
+			uint32_t* pIdx32 = reinterpret_cast<uint32_t*>(pIdxGrp);
+			for (uint32_t j = 0; j < count; ++j) {
+				pIdx32[j] = idx[j] - grp.mBaseVtx;
+			}
 		} else {
-			*pNamesItr = mi.mName;
+			for (uint32_t j = 0; j < count; ++j) {
+				pIdxGrp[j] = (uint16_t)(idx[j] - grp.mBaseVtx);
+			}
+		}
+	};
+
+	uint32_t partOffset = 0;
+	uint32_t jntOffset = 0;
+	uint32_t meshletOffset = 0;
+	for (int i = 0; i < numGrp; ++i) {
+		auto const& srcGrp = src.mGroups[i];
+		auto& grp = pGroups[i];
+
+		write_idx(grp, grp.mIdxOffset, srcGrp.mIdx);
+
+		grp.mPolyType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		grp.mSkinPartOffset = partOffset;
+		grp.mSkinPartNum = (uint32_t)srcGrp.mSkinParts.size();
+
+		for (auto part : srcGrp.mSkinParts) {
+			part.mJntOffset += jntOffset;
+			pSkinParts[partOffset++] = part;
+		}
+		for (uint32_t j = 0; j < grp.mLodNum; ++j) {
+			auto const& srcLod = srcGrp.mLods[j];
+			auto& lod = pLods[grp.mLodOffset + j];
+			write_idx(grp, lod.mIdxOffset, srcLod.mIdx);
+
+			lod.mSkinPartOffset = partOffset;
+			for (auto part : srcLod.mSkinParts) {
+				part.mJntOffset += jntOffset;
+				pSkinParts[partOffset++] = part;
+			}
+		}
+		for (uint16_t jnt : srcGrp.mSkinJnt) {
+			pSkinJnt[jntOffset++] = jnt;
+		}
+
+		grp.mMeshletOffset = meshletOffset;
+		grp.mMeshletNum = (uint32_t)srcGrp.mMeshlets.size();
+		for (auto const& meshlet : srcGrp.mMeshlets) {
+			pMeshlets[meshletOffset++] = meshlet;
 		}
-		
 
-		++pGrpItr;
-		++pNamesItr;
+		pNames[i] = srcGrp.mName;
 	}
 
-	auto pDev = get_gfx().get_dev();
-	mVtx.init(pDev, pVtx.get(), numVtx, vtxSize);
-	mIdx.init(pDev, pIdx.get(), numIdx, idxFormat);
+	const eVtxFmt vtxFmt = nVtxFmt::choose(src.mVtx.data(), numVtx);
+	const uint32_t vtxSize = nVtxFmt::get_size(vtxFmt);
+	auto pVtx = std::make_unique<uint8_t[]>(size_t(numVtx) * vtxSize);
+	nVtxFmt::encode(vtxFmt, src.mVtx.data(), numVtx, pVtx.get());
+	if (vtxFmt != E_VTX_FMT_F32) {
+		const auto err = nVtxFmt::round_trip_error(vtxFmt, src.mVtx.data(), numVtx);
+		const uint32_t srcSize = sizeof(sModelVtx);
+		dbg_msg("model: %s vertices, %u -> %u bytes (%.1f KB -> %.1f KB, %.2fx less fetch bandwidth)\n",
+			nVtxFmt::get_name(vtxFmt), srcSize, vtxSize,
+			numVtx * srcSize / 1024.0f, numVtx * vtxSize / 1024.0f, float(srcSize) / vtxSize);
+		dbg_msg("model: max error pos %.2g nrm %.2g tgt %.2g uv %.2g clr %.2g wgt %.2g\n",
+			err.mPos, err.mNrm, err.mTgt, err.mUV, err.mClr, err.mWgt);
+	}
 
+	auto pDev = get_gfx().get_dev();
+	free_pooled();
+	mVtx.deinit();
+	mIdx.deinit();
+	if (src.mPooled) {
+		auto& heap = cGeoHeap::get();
+		auto pCtx = get_gfx().get_imm_ctx();
+		mVtxAlloc = heap.alloc_vtx(pCtx, pVtx.get(), numVtx, vtxSize);
+		mIdxAlloc = heap.alloc_idx(pCtx, pIdx.get(), std::max(idxUnits, 1u));
+	} else {
+		mVtx.init(pDev, pVtx.get(), numVtx, vtxSize);
+		// Groups select their own index format, the buffer is sized in 16 bit units
+		mIdx.init(pDev, pIdx.get(), std::max(idxUnits, 1u), DXGI_FORMAT_R16_UINT);
+	}
+	mVtxFmt = vtxFmt;
+	mVtxNum = numVtx;
+	mpSkinVtx = build_skin_vtx(src);
+
+	mPosStream = src.mDepthStreams;
+	mJntStream = src.mDepthStreams && mpSkinVtx;
+	mPosVtx.deinit();
+	mJntVtx.deinit();
+	if (mPosStream) {
+		auto pPos = std::make_unique<vec3[]>(numVtx);
+		nVtxFmt::encode_pos(src.mVtx.data(), numVtx, pPos.get());
+		mPosVtx.init(pDev, pPos.get(), numVtx, sizeof(vec3));
+		uint32_t depthSize = sizeof(vec3);
+		if (mJntStream) {
+			// Partitioned joint indices are part-local and fit 8 bits
+			auto pJnt = std::make_unique<sModelVtxJnt[]>(numVtx);
+			nVtxFmt::encode_jnt(src.mVtx.data(), numVtx, pJnt.get());
+			mJntVtx.init(pDev, pJnt.get(), numVtx, sizeof(sModelVtxJnt));
+			depthSize += sizeof(sModelVtxJnt);
+		}
+		dbg_msg("model: depth streams %u bytes per vertex, %.0f%% less fetch bandwidth than %s, %.0f%% than f32\n",
+			depthSize, 100.0f * (1.0f - float(depthSize) / vtxSize), nVtxFmt::get_name(vtxFmt),
+			100.0f * (1.0f - float(depthSize) / sizeof(sModelVtx)));
+	}
+	mSkinBoundsNum = 0;
+	mpSkinBounds.reset();
+	if (mpSkinVtx) {
+		build_skin_bounds(mpSkinVtx.get(), mVtxNum, mSkinBoundsNum, mpSkinBounds);
+	}
 	mGrpNum = numGrp;
 	mpGroups = std::move(pGroups);
 	mpGrpNames = std::move(pNames);
+	mSkinPartsNum = numParts;
+	mpSkinParts = std::move(pSkinParts);
+	mpSkinJnt = std::move(pSkinJnt);
+	mLodsNum = numLods;
+	mpLods = std::move(pLods);
+	mBounds = bounds;
+	mSphere = sphere;
+	mpGrpBounds = std::move(pGrpBounds);
+	mpGrpSpheres = std::move(pGrpSpheres);
+	mMeshletsNum = numMeshlets;
+	mGrpMeshletsMax = grpMeshletsMax;
+	mpMeshlets = std::move(pMeshlets);
+
+	mpSrc.reset();
+	if (mKeepSrc) {
+		mpSrc = std::make_unique<sModelSrc>(std::move(src));
+	}
 
 	return true;
 }
 
+void cModelData::free_pooled() {
+	auto& heap = cGeoHeap::get();
+	heap.free_vtx(mVtxAlloc);
+	if (mIdxAlloc != cRangeAllocator::INVALID) {
+		heap.free_idx(mIdxAlloc);
+	}
+}
+
+cVertexBuffer const& cModelData::get_vtx() const {
+	return mVtxAlloc.is_valid() ? cGeoHeap::get().get_vtx_buf(mVtxAlloc) : mVtx;
+}
+
+cIndexBuffer const& cModelData::get_idx() const {
+	return mIdxAlloc != cRangeAllocator::INVALID ? cGeoHeap::get().get_idx_buf() : mIdx;
+}
+
+uint32_t cModelData::get_base_vtx() const {
+	return mVtxAlloc.is_valid() ? cGeoHeap::get().get_base_vtx(mVtxAlloc) : 0;
+}
+
+uint32_t cModelData::get_idx_offset() const {
+	return mIdxAlloc != cRangeAllocator::INVALID ? cGeoHeap::get().get_idx_offset(mIdxAlloc) : 0;
+}
+
 void cModelData::unload() {
 	mVtx.deinit();
 	mIdx.deinit();
+	free_pooled();
+	mPosVtx.deinit();
+	mJntVtx.deinit();
+	mPosStream = false;
+	mJntStream = false;
 	mpGroups.release();
 	mpGrpNames.release();
+	mpSkinParts.reset();
+	mpSkinJnt.reset();
+	mSkinPartsNum = 0;
+	mpLods.reset();
+	mLodsNum = 0;
+	mpGrpBounds.reset();
+	mpGrpSpheres.reset();
+	mBvh.clear();
+	mpMeshlets.reset();
+	mMeshletsNum = 0;
+	mGrpMeshletsMax = 0;
+	mpSkinVtx.reset();
+	mVtxNum = 0;
+	mpSkinBounds.reset();
+	mSkinBoundsNum = 0;
+	mpSrc.reset();
 }
 
 
@@ -388,63 +799,267 @@ bool cModel::init(cModelData const& mdlData, cModelMaterial& mtl) {
 	mpData = &mdlData;
 	mpMtl = &mtl;
 
+	const eVtxFmt vtxFmt = (eVtxFmt)mdlData.mVtxFmt;
 	auto& ss = cShaderStorage::get();
-	auto pVS = ss.load_VS("model_solid.vs.cso");
-
-	D3D11_INPUT_ELEMENT_DESC vdsc[] = {
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, pos), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, nrm), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(sModelVtx, uv), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(sModelVtx, tgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, bitgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(sModelVtx, uv1), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, clr), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "BLENDINDEX", 0, DXGI_FORMAT_R32G32B32A32_SINT, 0, offsetof(sModelVtx, jidx), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "BLENDWEIGHT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(sModelVtx, jwgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
-	};
+	auto pVS = ss.load_VS(nVtxFmt::get_layout_vs(vtxFmt));
+	if (!pVS) { return false; }
+
+	uint32_t vdscNum = 0;
+	auto vdsc = nVtxFmt::get_input_desc(vtxFmt, vdscNum);
 	auto pDev = get_gfx().get_dev();
 	auto& code = pVS->get_code();
-	HRESULT hr = pDev->CreateInputLayout(vdsc, LENGTHOF_ARRAY(vdsc), code.get_code(), code.get_size(), mpIL.pp());
+	HRESULT hr = pDev->CreateInputLayout(vdsc, vdscNum, code.get_code(), code.get_size(), mpIL.pp());
 	if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateInputLayout failed");
 
+	if (mdlData.mPosStream) {
+		auto pDepthVS = ss.load_VS(nVtxFmt::get_depth_layout_vs(mdlData.mJntStream));
+		if (!pDepthVS) { return false; }
+		vdsc = nVtxFmt::get_depth_input_desc(mdlData.mJntStream, vdscNum);
+		auto& depthCode = pDepthVS->get_code();
+		hr = pDev->CreateInputLayout(vdsc, vdscNum, depthCode.get_code(), depthCode.get_size(), mpDepthIL.pp());
+		if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateInputLayout failed");
+	}
+
 	mWmtx = DirectX::XMMatrixIdentity();
+	mWorldBoundsValid = false;
+	mpGrpLod = std::make_unique<uint8_t[]>(mdlData.mGrpNum);
+	mpCullRanges = mdlData.mGrpMeshletsMax ? std::make_unique<nMeshlet::sRange[]>(mdlData.mGrpMeshletsMax) : nullptr;
+
+	mpGrpSort.reset();
+	for (uint32_t i = 0; i < mdlData.mGrpNum; ++i) {
+		if (!mtl.mpGrpMtl[i].depthSort) { continue; }
+		if (!mdlData.mpSrc) {
+			dbg_msg("model: %s is drawn unsorted, depth sorting needs the import source\n", mdlData.mpGrpNames[i].c_str());
+			continue;
+		}
+		if (!mpGrpSort) {
+			mpGrpSort = std::make_unique<cTriSorter[]>(mdlData.mGrpNum);
+		}
+		sGroup const& grp = mdlData.mpGroups[i];
+		mpGrpSort[i].init(mdlData.mpSrc->mGroups[i], mdlData.mpSrc->mVtx.data(), grp.mBaseVtx, (DXGI_FORMAT)grp.mIdxFormat);
+	}
 
 	return true;
 }
 
 void cModel::deinit() {
 	mpData = nullptr;
+	mpGrpLod.reset();
+	mpCullRanges.reset();
+	mpGrpSort.reset();
 	if (mpIL) {
 		mpIL->Release();
 		mpIL = nullptr;
 	}
+	if (mpDepthIL) {
+		mpDepthIL->Release();
+		mpDepthIL = nullptr;
+	}
+}
+
+void cModel::update_world_bounds() const {
+	if (mWorldBoundsValid && ::memcmp(&mBoundsWmtx, &mWmtx, sizeof(mWmtx)) == 0) { return; }
+	mBoundsWmtx = mWmtx;
+	mWorldBounds = mpData->mBounds.transform(mWmtx);
+	mWorldSphere = mpData->mSphere.transform(mWmtx);
+	mWorldBoundsValid = true;
+}
+
+sAABB const& cModel::get_world_bounds() const {
+	update_world_bounds();
+	return mWorldBounds;
+}
+
+sSphere const& cModel::get_world_sphere() const {
+	update_world_bounds();
+	return mWorldSphere;
 }
 
-void cModel::disp(cRdrContext const& rdrCtx) const {
+bool XM_CALLCONV cModel::raycast(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax, sBvhHit& hit) const {
+	if (!mpData || mpData->mBvh.is_empty()) { return false; }
+	const DirectX::XMMATRIX inv = DirectX::XMMatrixInverse(nullptr, mWmtx);
+	return mpData->mBvh.intersect(DirectX::XMVector3TransformCoord(org, inv), DirectX::XMVector3TransformNormal(dir, inv), tmax, hit);
+}
+
+bool XM_CALLCONV cModel::occluded(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax) const {
+	if (!mpData || mpData->mBvh.is_empty()) { return false; }
+	const DirectX::XMMATRIX inv = DirectX::XMMatrixInverse(nullptr, mWmtx);
+	return mpData->mBvh.occluded(DirectX::XMVector3TransformCoord(org, inv), DirectX::XMVector3TransformNormal(dir, inv), tmax);
+}
+
+uint32_t cModel::select_lod(uint32_t grpIdx, float pxPerUnit) const {
+	sGroup const& grp = mpData->mpGroups[grpIdx];
+	if (grp.mLodNum == 0) { return 0; }
+
+	auto projected_error = [&](uint32_t lod) {
+		return lod ? mpData->mpLods[grp.mLodOffset + lod - 1].mError * pxPerUnit : 0.0f;
+	};
+
+	uint32_t lod = std::min<uint32_t>(mpGrpLod[grpIdx], grp.mLodNum);
+	while (lod > 0 && projected_error(lod) > mLodErrorPx) {
+		--lod;
+	}
+	while (lod < grp.mLodNum && projected_error(lod + 1) < mLodErrorPx * (1.0f - mLodHysteresis)) {
+		++lod;
+	}
+	mpGrpLod[grpIdx] = (uint8_t)lod;
+	return lod;
+}
+
+void cModel::disp(cRdrContext const& rdrCtx, cRig const* pRig/* = nullptr*/) const {
+	if (!mpData) return;
+
+	auto pCtx = rdrCtx.get_ctx();
+	pCtx->IASetInputLayout(mpIL);
+
+	cBlendStates::get().set_opaque(pCtx);
+
+	// Groups are addressed with the base vertex of the draw
+	mpData->get_vtx().set(pCtx, 0, 0);
+
+	disp_groups(rdrCtx, pRig, false);
+}
+
+void cModel::disp_depth(cRdrContext const& rdrCtx, cRig const* pRig/* = nullptr*/) const {
 	if (!mpData) return;
 
+	auto pCtx = rdrCtx.get_ctx();
+	if (mpDepthIL) {
+		pCtx->IASetInputLayout(mpDepthIL);
+		mpData->mPosVtx.set(pCtx, 0, 0);
+		if (mpData->mJntStream) {
+			mpData->mJntVtx.set(pCtx, 1, 0);
+		}
+	} else {
+		pCtx->IASetInputLayout(mpIL);
+		mpData->get_vtx().set(pCtx, 0, 0);
+	}
+
+	cBlendStates::get().set_opaque(pCtx);
+
+	disp_groups(rdrCtx, pRig, true);
+}
+
+void cModel::disp_groups(cRdrContext const& rdrCtx, cRig const* pRig, bool depth) const {
 	auto pCtx = rdrCtx.get_ctx();
 	auto& meshCBuf = rdrCtx.get_cbufs().mMeshCBuf;
 
+	// Pixels covered by a model space unit at the nearest point of the bounding sphere
+	float pxPerUnit = 0.0f;
+	if (mpData->mLodsNum) {
+		auto const& cam = rdrCtx.get_cbufs().mCameraCBuf.mData;
+		auto const& sphere = get_world_sphere();
+		const float dist = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(cam.camPos, sphere.get_center()))) - sphere.get_radius();
+		float scale = 0.0f;
+		for (int i = 0; i < 3; ++i) {
+			scale = std::max(scale, DirectX::XMVectorGetX(DirectX::XMVector3Length(mWmtx.r[i])));
+		}
+		const float halfHeight = 0.5f * (float)get_window_size().y;
+		pxPerUnit = scale * DirectX::XMVectorGetY(cam.proj.r[1]) * halfHeight / std::max(dist, 1e-3f);
+	}
+
 	meshCBuf.mData.wmtx = mWmtx;
 	meshCBuf.update(pCtx);
 	meshCBuf.set_VS(pCtx);
 
-	pCtx->IASetInputLayout(mpIL);
+	nMeshlet::sCullView cullView;
+	bool cullCones = false;
+	mCullStats = {};
+	if (mMeshletCull && mpCullRanges) {
+		auto const& cam = rdrCtx.get_cbufs().mCameraCBuf.mData;
+		cullView.init(mWmtx, cam.viewProj, cam.camPos);
+		cullCones = cullView.mCones;
+	}
 
-	cBlendStates::get().set_opaque(pCtx);
+	// View depth of model space points, the third column of the model-view matrix
+	DirectX::XMVECTOR viewZ = DirectX::XMVectorZero();
+	if (!depth && mpGrpSort) {
+		auto const& cam = rdrCtx.get_cbufs().mCameraCBuf.mData;
+		viewZ = DirectX::XMMatrixTranspose(DirectX::XMMatrixMultiply(mWmtx, cam.view)).r[2];
+		mSortStats = {};
+	}
 
 	auto grpNum = mpData->mGrpNum;
 	for (uint32_t i = 0; i < grpNum; ++i) {
 		sGroup const& grp = mpData->mpGroups[i];
 
-		mpMtl->apply(rdrCtx, i);
+		if (depth) {
+			mpMtl->apply_depth(rdrCtx, i);
+		} else {
+			mpMtl->apply(rdrCtx, i);
+		}
+
+		// Order doesn't matter for depth, sorted groups are drawn at full detail without meshlet culling
+		cTriSorter* pSort = !depth && mpGrpSort && mpGrpSort[i].get_tri_num() ? &mpGrpSort[i] : nullptr;
+		if (pSort) {
+			const auto start = std::chrono::steady_clock::now();
+			if (pSort->sort(pCtx, viewZ)) {
+				mSortStats.mSorted++;
+			} else {
+				mSortStats.mKept++;
+			}
+			mSortStats.mSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			mSortStats.mTris += pSort->get_tri_num();
+
+			pSort->get_idx().set(pCtx, 0, pSort->get_idx_format());
+			pCtx->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)grp.mPolyType);
+			const int baseVtx = mpData->get_base_vtx() + grp.mBaseVtx;
+			if (grp.mSkinPartNum && pRig) {
+				for (uint32_t j = 0; j < grp.mSkinPartNum; ++j) {
+					sSkinPart const& part = mpData->mpSkinParts[grp.mSkinPartOffset + j];
+					pRig->upload_skin(rdrCtx, &mpData->mpSkinJnt[part.mJntOffset], part.mJntNum);
+					pCtx->DrawIndexed(part.mIdxCount, part.mIdxStart, baseVtx);
+				}
+			} else {
+				pCtx->DrawIndexed(grp.mIdxCount, 0, baseVtx);
+			}
+			continue;
+		}
+
+		uint32_t idxOffset = grp.mIdxOffset;
+		uint32_t idxCount = grp.mIdxCount;
+		uint32_t partOffset = grp.mSkinPartOffset;
+		const uint32_t lod = select_lod(i, pxPerUnit);
+		if (lod) {
+			sGroupLod const& grpLod = mpData->mpLods[grp.mLodOffset + lod - 1];
+			idxOffset = grpLod.mIdxOffset;
+			idxCount = grpLod.mIdxCount;
+			partOffset = grpLod.mSkinPartOffset;
+		}
 
-		mpData->mVtx.set(pCtx, 0, grp.mVtxOffset);
-		mpData->mIdx.set(pCtx, grp.mIdxOffset);
+		mpData->get_idx().set(pCtx, mpData->get_idx_offset() + idxOffset, (DXGI_FORMAT)grp.mIdxFormat);
 		pCtx->IASetPrimitiveTopology((D3D11_PRIMITIVE_TOPOLOGY)grp.mPolyType);
+		// Depth streams are per model, only the main stream lives in the geometry heap
+		const int baseVtx = (depth && mpData->mPosStream ? 0 : mpData->get_base_vtx()) + grp.mBaseVtx;
+
+		if (grp.mSkinPartNum && pRig) {
+			for (uint32_t j = 0; j < grp.mSkinPartNum; ++j) {
+				sSkinPart const& part = mpData->mpSkinParts[partOffset + j];
+				pRig->upload_skin(rdrCtx, &mpData->mpSkinJnt[part.mJntOffset], part.mJntNum);
+				pCtx->DrawIndexed(part.mIdxCount, part.mIdxStart, baseVtx);
+			}
+			continue;
+		}
+
+		if (lod == 0 && grp.mMeshletNum && mMeshletCull && mpCullRanges) {
+			// Backfacing cones don't apply when both sides are drawn
+			cullView.mCones = cullCones && !mpMtl->mpGrpMtl[i].twosided;
+			const auto start = std::chrono::steady_clock::now();
+			const uint32_t rangesNum = nMeshlet::cull(&mpData->mpMeshlets[grp.mMeshletOffset], grp.mMeshletNum, cullView, mpCullRanges.get());
+			mCullStats.mSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			mCullStats.mTested += grp.mMeshletNum;
+			mCullStats.mTrisTested += idxCount / 3;
+			mCullStats.mDraws += rangesNum;
+			for (uint32_t j = 0; j < rangesNum; ++j) {
+				auto const& range = mpCullRanges[j];
+				mCullStats.mTrisDrawn += range.mIdxCount / 3;
+				pCtx->DrawIndexed(range.mIdxCount, range.mIdxStart, baseVtx);
+			}
+			continue;
+		}
+
 		//pCtx->Draw(grp.mIdxCount, 0);
-		pCtx->DrawIndexed(grp.mIdxCount, 0, 0);
+		pCtx->DrawIndexed(idxCount, 0, baseVtx);
 	}
 
 }
@@ -455,13 +1070,50 @@ void cModel::dbg_ui() {
 	auto grpNum = mpData->mGrpNum;
 	char buf[64];
 	ImGui::Begin("model");
+	{
+		auto const& bounds = get_world_bounds();
+		DirectX::XMFLOAT3 bmin, bmax;
+		DirectX::XMStoreFloat3(&bmin, bounds.mMin);
+		DirectX::XMStoreFloat3(&bmax, bounds.mMax);
+		ImGui::LabelText("bounds min", "%.2f %.2f %.2f", bmin.x, bmin.y, bmin.z);
+		ImGui::LabelText("bounds max", "%.2f %.2f %.2f", bmax.x, bmax.y, bmax.z);
+		ImGui::LabelText("radius", "%.2f", get_world_sphere().get_radius());
+	}
+	if (mpData->mLodsNum) {
+		ImGui::SliderFloat("lod error px", &mLodErrorPx, 0.1f, 16.0f);
+		ImGui::SliderFloat("lod hysteresis", &mLodHysteresis, 0.0f, 0.9f);
+	}
+	if (mpData->mMeshletsNum) {
+		ImGui::Checkbox("meshlet cull", &mMeshletCull);
+		if (mMeshletCull && mCullStats.mTested) {
+			ImGui::LabelText("meshlet tris", "%u/%u in %u draws", mCullStats.mTrisDrawn, mCullStats.mTrisTested, mCullStats.mDraws);
+			ImGui::LabelText("meshlets/ms", "%.0f (%u)", mCullStats.mTested / std::max(mCullStats.mSeconds * 1e3, 1e-6), mCullStats.mTested);
+		}
+	}
+	if (mpGrpSort) {
+		ImGui::LabelText("depth sort", "%u tris, %.3f ms, %u sorted, %u kept", mSortStats.mTris, mSortStats.mSeconds * 1e3, mSortStats.mSorted, mSortStats.mKept);
+	}
+	if (!mpData->mBvh.is_empty()) {
+		auto const& bvhStats = mpData->mBvh.get_stats();
+		ImGui::LabelText("bvh", "%u tris, %u nodes, depth %u, %.1f ms", bvhStats.mTris, bvhStats.mNodes, bvhStats.mDepth, bvhStats.mBuildSeconds * 1e3);
+		if (ImGui::Button("bvh bench")) {
+			mBvhBench = mpData->mBvh.bench(BVH_BENCH_RAYS);
+		}
+		if (mBvhBench.mRays) {
+			ImGui::LabelText("rays/s", "%.2fM closest, %.2fM any (%u/%u hit)", mBvhBench.mClosestPerSec * 1e-6, mBvhBench.mAnyPerSec * 1e-6, mBvhBench.mHits, mBvhBench.mRays);
+		}
+	}
 	for (uint32_t i = 0; i < grpNum; ++i) {
-		//sGroup const& grp = mpData->mpGroups[i];
+		sGroup const& grp = mpData->mpGroups[i];
 		auto const& name = mpData->mpGrpNames[i];
 		sGroupMaterial& mtl = mpMtl->mpGrpMtl[i];
 
 		::sprintf_s(buf, "grp #%d:%s", i, name.c_str());
 		if (ImGui::CollapsingHeader(buf)) {
+			if (grp.mLodNum) {
+				ImGui::LabelText("lod", "%u/%u", mpGrpLod[i], grp.mLodNum);
+			}
+
 			ImGui::PushID(&mtl);
 
 			ImguiSlideFloat3_1("F0", mtl.params.fresnel, 0.0f, 1.0f);
@@ -502,6 +1154,14 @@ void sGroupMtlRes::apply(cRdrContext const& rdrCtx) {
 	cRasterizerStates::set(pCtx, mpRSState);
 }
 
+void sGroupMtlRes::apply_depth(cRdrContext const& rdrCtx) {
+	auto pCtx = rdrCtx.get_ctx();
+	pCtx->VSSetShader(mpDepthVS ? mpDepthVS->asVS() : mpVS->asVS(), nullptr, 0);
+	pCtx->PSSetShader(nullptr, nullptr, 0);
+
+	cRasterizerStates::set(pCtx, mpRSState);
+}
+
 void sGroupMaterial::apply(cRdrContext const& rdrCtx) const {
 	auto& cbs = rdrCtx.get_cbufs();
 	cbs.mTestMtlCBuf.mData = params;
@@ -514,6 +1174,10 @@ void cModelMaterial::apply(cRdrContext const& rdrCtx, int i) const {
 	mpGrpRes[i].apply(rdrCtx);
 }
 
+void cModelMaterial::apply_depth(cRdrContext const& rdrCtx, int i) const {
+	mpGrpRes[i].apply_depth(rdrCtx);
+}
+
 void sGroupMaterial::set_default(bool isSkinned) {
 	params.fresnel[0] = 0.025f;
 	params.fresnel[1] = 0.025f;
@@ -523,6 +1187,8 @@ void sGroupMaterial::set_default(bool isSkinned) {
 	params.nmap1Power = 0.0f;
 
 	twosided = false;
+	dqSkin = false;
+	depthSort = false;
 	vsProg = isSkinned ? "model_skin.vs.cso" : "model_solid.vs.cso";
 	psProg = "model.ps.cso";
 }
@@ -573,11 +1239,23 @@ bool cModelMaterial::load(ID3D11Device* pDev, cModelData const& mdlData, const f
 		loadNmap(mtl.texNmap1Name, res.mpTexNmap1, res.mpSmpNmap1);
 		loadClr(mtl.texMaskName, res.mpTexMask, res.mpSmpMask);
 
-		res.mpVS = ss.load_VS(mtl.vsProg.c_str());
+		const std::string vsProg = nVtxFmt::get_vs_variant(mtl.dqSkin ? "model_skin_dq.vs.cso" : mtl.vsProg,
+			(eVtxFmt)mpMdlData->mVtxFmt);
+		res.mpVS = ss.load_VS(vsProg.c_str());
 		if (!res.mpVS) { return false; }
 		res.mpPS = ss.load_PS(mtl.psProg.c_str());
 		if (!res.mpPS) { return false; }
 
+		res.mpDepthVS = nullptr;
+		if (mpMdlData->mPosStream) {
+			// Without joints every group takes the not skinned variant, as the layout has no joint elements
+			const std::string depthVS = mpMdlData->mJntStream
+				? nVtxFmt::get_depth_vs_variant(mtl.dqSkin ? "model_skin_dq.vs.cso" : mtl.vsProg)
+				: nVtxFmt::get_depth_layout_vs(false);
+			res.mpDepthVS = ss.load_VS(depthVS.c_str());
+			if (!res.mpDepthVS) { return false; }
+		}
+
 		if (mtl.twosided) {
 			res.mpRSState = cRasterizerStates::get().twosided();
 		} else {
@@ -588,6 +1266,17 @@ bool cModelMaterial::load(ID3D11Device* pDev, cModelData const& mdlData, const f
 	return true;
 }
 
+uint32_t cModelMaterial::get_skin_palettes() const {
+	if (!mpMdlData || !mpGrpMtl) { return E_SKIN_PALETTE_MTX; }
+
+	uint32_t palettes = 0;
+	auto grpNum = mpMdlData->mGrpNum;
+	for (uint32_t i = 0; i < grpNum; ++i) {
+		palettes |= mpGrpMtl[i].dqSkin ? E_SKIN_PALETTE_DQ : E_SKIN_PALETTE_MTX;
+	}
+	return palettes;
+}
+
 bool cModelMaterial::save(const fs::path& filepath) {
 	if (!mpMdlData || !mpGrpMtl) return false;
 	
@@ -2,15 +2,39 @@
 #include <string>
 
 struct sModelVtx;
+struct sModelSrc;
+struct sSkinVtx;
 class cShader;
+class cRig;
 class cAssimpLoader;
 class cRdrContext;
 
 struct sGroup {
-	uint32_t mVtxOffset;
+	// Added to indices of the group, which are relative to its lowest vertex
+	uint32_t mBaseVtx;
+	// DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT, byte offset is aligned to the index size
+	uint32_t mIdxFormat;
 	uint32_t mIdxOffset;
 	uint32_t mIdxCount;
 	uint32_t mPolyType;
+	uint32_t mSkinPartOffset;
+	uint32_t mSkinPartNum;
+	// Simplified levels in cModelData::mpLods, from the most detailed
+	uint32_t mLodOffset;
+	uint32_t mLodNum;
+	// Meshlets of the full detail level in cModelData::mpMeshlets
+	uint32_t mMeshletOffset;
+	uint32_t mMeshletNum;
+};
+
+// Simplified level of a group, drawn with the group's index format and base vertex
+struct sGroupLod {
+	uint32_t mIdxOffset;
+	uint32_t mIdxCount;
+	// mSkinPartNum parts of the group, with ranges in this level
+	uint32_t mSkinPartOffset;
+	// Object space distance error
+	float mError;
 };
 
 class cModelData : noncopyable {
@@ -19,22 +43,124 @@ public:
 	std::unique_ptr<sGroup[]> mpGroups;
 	std::unique_ptr<std::string[]> mpGrpNames;
 
+	uint32_t mSkinPartsNum = 0;
+	std::unique_ptr<sSkinPart[]> mpSkinParts;
+	std::unique_ptr<uint16_t[]> mpSkinJnt;
+
+	uint32_t mLodsNum = 0;
+	std::unique_ptr<sGroupLod[]> mpLods;
+
+	// Model space bounds of the whole model and of every group
+	sAABB mBounds;
+	sSphere mSphere;
+	std::unique_ptr<sAABB[]> mpGrpBounds;
+	std::unique_ptr<sSphere[]> mpGrpSpheres;
+	// Bind pose triangles of all groups, empty when not built
+	cTriBvh mBvh;
+
+	uint32_t mMeshletsNum = 0;
+	// Largest number of meshlets in a group
+	uint32_t mGrpMeshletsMax = 0;
+	std::unique_ptr<sMeshlet[]> mpMeshlets;
+
+	// eVtxFmt of mVtx
+	uint32_t mVtxFmt = 0;
+	// CPU skinning input matching mVtx, null for not skinned models
+	uint32_t mVtxNum = 0;
+	std::unique_ptr<sSkinVtx[]> mpSkinVtx;
+	// Bind pose bounds of vertices influenced by each skin joint, see cRig::calc_skinned_aabb
+	uint32_t mSkinBoundsNum = 0;
+	std::unique_ptr<sAABB[]> mpSkinBounds;
+
+	// Own buffers, or ranges of cGeoHeap for pooled models, see get_vtx()
 	cVertexBuffer mVtx;
 	cIndexBuffer mIdx;
+	sGeoAlloc mVtxAlloc;
+	uint32_t mIdxAlloc = cRangeAllocator::INVALID;
+	// Positions, and joints of skinned models, for passes which don't need other attributes
+	bool mPosStream = false;
+	bool mJntStream = false;
+	cVertexBuffer mPosVtx;
+	cVertexBuffer mJntVtx;
+
+	// Set before loading to keep the processed import source in mpSrc, see cStaticBatch
+	bool mKeepSrc = false;
+	std::unique_ptr<sModelSrc> mpSrc;
 
 public:
 	cModelData() {}
+	~cModelData() { free_pooled(); }
 	cModelData(cModelData&& o) : 
+		mGrpNum(o.mGrpNum),
 		mpGroups(std::move(o.mpGroups)),
 		mpGrpNames(std::move(o.mpGrpNames)),
+		mSkinPartsNum(o.mSkinPartsNum),
+		mpSkinParts(std::move(o.mpSkinParts)),
+		mpSkinJnt(std::move(o.mpSkinJnt)),
+		mLodsNum(o.mLodsNum),
+		mpLods(std::move(o.mpLods)),
+		mBounds(o.mBounds),
+		mSphere(o.mSphere),
+		mpGrpBounds(std::move(o.mpGrpBounds)),
+		mpGrpSpheres(std::move(o.mpGrpSpheres)),
+		mBvh(std::move(o.mBvh)),
+		mMeshletsNum(o.mMeshletsNum),
+		mGrpMeshletsMax(o.mGrpMeshletsMax),
+		mpMeshlets(std::move(o.mpMeshlets)),
+		mVtxFmt(o.mVtxFmt),
+		mVtxNum(o.mVtxNum),
+		mpSkinVtx(std::move(o.mpSkinVtx)),
+		mSkinBoundsNum(o.mSkinBoundsNum),
+		mpSkinBounds(std::move(o.mpSkinBounds)),
 		mVtx(std::move(o.mVtx)),
-		mIdx(std::move(o.mIdx))
-	{}
+		mIdx(std::move(o.mIdx)),
+		mVtxAlloc(o.mVtxAlloc),
+		mIdxAlloc(o.mIdxAlloc),
+		mPosStream(o.mPosStream),
+		mJntStream(o.mJntStream),
+		mPosVtx(std::move(o.mPosVtx)),
+		mJntVtx(std::move(o.mJntVtx)),
+		mKeepSrc(o.mKeepSrc),
+		mpSrc(std::move(o.mpSrc))
+	{
+		o.mVtxAlloc = sGeoAlloc();
+		o.mIdxAlloc = cRangeAllocator::INVALID;
+	}
 	cModelData& operator=(cModelData&& o) {
+		mGrpNum = o.mGrpNum;
 		mpGroups = std::move(o.mpGroups);
 		mpGrpNames = std::move(o.mpGrpNames);
+		mSkinPartsNum = o.mSkinPartsNum;
+		mpSkinParts = std::move(o.mpSkinParts);
+		mpSkinJnt = std::move(o.mpSkinJnt);
+		mLodsNum = o.mLodsNum;
+		mpLods = std::move(o.mpLods);
+		mBounds = o.mBounds;
+		mSphere = o.mSphere;
+		mpGrpBounds = std::move(o.mpGrpBounds);
+		mpGrpSpheres = std::move(o.mpGrpSpheres);
+		mBvh = std::move(o.mBvh);
+		mMeshletsNum = o.mMeshletsNum;
+		mGrpMeshletsMax = o.mGrpMeshletsMax;
+		mpMeshlets = std::move(o.mpMeshlets);
+		mVtxFmt = o.mVtxFmt;
+		mVtxNum = o.mVtxNum;
+		mpSkinVtx = std::move(o.mpSkinVtx);
+		mSkinBoundsNum = o.mSkinBoundsNum;
+		mpSkinBounds = std::move(o.mpSkinBounds);
 		mVtx = std::move(o.mVtx);
 		mIdx = std::move(o.mIdx);
+		free_pooled();
+		mVtxAlloc = o.mVtxAlloc;
+		mIdxAlloc = o.mIdxAlloc;
+		o.mVtxAlloc = sGeoAlloc();
+		o.mIdxAlloc = cRangeAllocator::INVALID;
+		mPosStream = o.mPosStream;
+		mJntStream = o.mJntStream;
+		mPosVtx = std::move(o.mPosVtx);
+		mJntVtx = std::move(o.mJntVtx);
+		mKeepSrc = o.mKeepSrc;
+		mpSrc = std::move(o.mpSrc);
 		return *this;
 	}
 
@@ -46,6 +172,17 @@ public:
 	bool load_assimp(const fs::path& filepath);
 	bool load_assimp(cAssimpLoader& loader);
 	bool load_hou_geo(const fs::path& filepath);
+
+	// Runs import stages on src and creates GPU buffers from the result
+	bool init(sModelSrc& src);
+
+	void free_pooled();
+
+	cVertexBuffer const& get_vtx() const;
+	cIndexBuffer const& get_idx() const;
+	// Added to the group base vertex and index byte offsets of draws
+	uint32_t get_base_vtx() const;
+	uint32_t get_idx_offset() const;
 };
 
 
@@ -58,6 +195,10 @@ struct sGroupMaterial {
 	std::string texNmap1Name;
 	std::string texMaskName;
 	bool twosided;
+	// Skinned with dual quaternions, uses model_skin_dq vertex shader instead of vsProg
+	bool dqSkin;
+	// Triangles drawn back to front every frame for blending, see cTriSorter
+	bool depthSort;
 public:
 	void apply(cRdrContext const& rdrCtx) const;
 	void set_default(bool isSkinned);
@@ -77,9 +218,12 @@ struct sGroupMtlRes {
 	ID3D11SamplerState* mpSmpMask = nullptr;
 	cShader* mpVS = nullptr;
 	cShader* mpPS = nullptr;
+	// Reads the position and joint streams, null without them
+	cShader* mpDepthVS = nullptr;
 	ID3D11RasterizerState* mpRSState = nullptr;
 
 	void apply(cRdrContext const& rdrCtx);
+	void apply_depth(cRdrContext const& rdrCtx);
 };
 
 class cModelMaterial {
@@ -102,6 +246,7 @@ public:
 	}
 
 	void apply(cRdrContext const& rdrCtx, int grp) const;
+	void apply_depth(cRdrContext const& rdrCtx, int grp) const;
 
 	bool load(ID3D11Device* pDev, cModelData const& mdlData, 
 		const fs::path& filepath, bool isSkinnedByDef = false);
@@ -109,19 +254,64 @@ public:
 
 	cstr get_grp_name(uint32_t i) const { return mpMdlData->mpGrpNames[i].c_str(); }
 
+	// eSkinPalette mask of palettes required by the groups
+	uint32_t get_skin_palettes() const;
+
 protected:
 	bool serialize(const fs::path& filepath);
 	bool deserialize(const fs::path& filepath);
 };
 
+struct sMeshletCullStats {
+	uint32_t mTested = 0;
+	uint32_t mTrisTested = 0;
+	uint32_t mTrisDrawn = 0;
+	uint32_t mDraws = 0;
+	double mSeconds = 0.0;
+};
+
 class cModel {
 	cModelData const* mpData = nullptr;
 	cModelMaterial* mpMtl = nullptr;
 
 	com_ptr<ID3D11InputLayout> mpIL;
+	com_ptr<ID3D11InputLayout> mpDepthIL;
+
+	// Current level of every group, kept between frames for hysteresis
+	mutable std::unique_ptr<uint8_t[]> mpGrpLod;
+
+	uint32_t select_lod(uint32_t grpIdx, float pxPerUnit) const;
+
+	// Visible ranges of a group, sized for the largest one
+	mutable std::unique_ptr<nMeshlet::sRange[]> mpCullRanges;
+	mutable sMeshletCullStats mCullStats;
+
+	// Per group, initialized for depthSort groups only. Needs the import source, see cModelData::mKeepSrc
+	mutable std::unique_ptr<cTriSorter[]> mpGrpSort;
+	mutable sTriSortStats mSortStats;
+
+	// World bounds and mWmtx they were computed for
+	mutable DirectX::XMMATRIX mBoundsWmtx;
+	mutable sAABB mWorldBounds;
+	mutable sSphere mWorldSphere;
+	mutable bool mWorldBoundsValid = false;
+
+	void update_world_bounds() const;
+
+	// Last result of the bench button in dbg_ui
+	sBvhBench mBvhBench;
+
+	// Draws all groups with the vertex buffers and input layout already set
+	void disp_groups(cRdrContext const& rdrCtx, cRig const* pRig, bool depth) const;
 
 public:
 	DirectX::XMMATRIX mWmtx;
+	// Projected error in pixels a level may have, and the fraction of it
+	// the next coarser level has to get below before switching to it
+	float mLodErrorPx = 1.0f;
+	float mLodHysteresis = 0.25f;
+	// Draw only meshlets in the frustum and not facing away
+	bool mMeshletCull = true;
 	
 	cModel() {}
 	~cModel() {}
@@ -129,7 +319,23 @@ public:
 	bool init(cModelData const& mdlData, cModelMaterial& mtl);
 	void deinit();
 
-	void disp(cRdrContext const& rdrCtx) const;
+	// Bind pose bounds under mWmtx, recomputed when it changes
+	sAABB const& get_world_bounds() const;
+	sSphere const& get_world_sphere() const;
+	sAABB get_grp_world_bounds(uint32_t grp) const { return mpData->mpGrpBounds[grp].transform(mWmtx); }
+
+	static const uint32_t BVH_BENCH_RAYS = 1000000;
+
+	// World space rays against the bind pose triangles under mWmtx, t is in units of dir.
+	// Return false when the model has no BVH.
+	bool XM_CALLCONV raycast(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax, sBvhHit& hit) const;
+	bool XM_CALLCONV occluded(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax) const;
+
+	// pRig is required to draw skin partitioned groups
+	void disp(cRdrContext const& rdrCtx, cRig const* pRig = nullptr) const;
+	// Depth only, fetches positions and joints without other attributes and binds no pixel shader.
+	// Falls back to the full vertices for models without the streams.
+	void disp_depth(cRdrContext const& rdrCtx, cRig const* pRig = nullptr) const;
 
 	void dbg_ui();
 };
@@ -0,0 +1,75 @@
+#include <string>
+#include <vector>
+
+// Sub-draw of a skinned group referencing a limited number of joints.
+// jidx of its vertices are indices into the part's joints list.
+struct sSkinPart {
+	uint32_t mIdxStart; // relative to the group start
+	uint32_t mIdxCount;
+	uint32_t mJntOffset;
+	uint32_t mJntNum;
+};
+
+// Cluster of consecutive triangles of a group with culling bounds, see nMeshlet
+struct sMeshlet {
+	vec3 mCenter;
+	float mRadius;
+	// Triangle normals are within the cone around the axis
+	vec3 mConeAxis;
+	// Sine of the cone spread, greater than 1 when the cone is too wide to be culled
+	float mConeCutoff;
+	uint32_t mIdxStart; // relative to the group start
+	uint32_t mIdxCount;
+};
+
+// Simplified level of a group, indexing the same vertices as the full detail one
+struct sModelSrcLod {
+	// Object space distance error
+	float mError = 0.0f;
+	std::vector<uint32_t> mIdx;
+	// Ranges of the group's skin parts in mIdx, joints are shared with the full detail level
+	std::vector<sSkinPart> mSkinParts;
+};
+
+struct sModelSrcGroup {
+	std::string mName;
+	// Triangle list, indices into sModelSrc::mVtx
+	std::vector<uint32_t> mIdx;
+
+	std::vector<sSkinPart> mSkinParts;
+	std::vector<uint16_t> mSkinJnt;
+
+	// Coarser levels, from the most detailed
+	std::vector<sModelSrcLod> mLods;
+
+	// Covering mIdx, empty for skinned groups
+	std::vector<sMeshlet> mMeshlets;
+};
+
+// Per attribute tolerances under which vertices are welded at import, compared per component.
+// Joint indices of weighted influences must match exactly.
+struct sVtxWeldEps {
+	bool mEnable = true;
+	float mPos = 1e-5f;
+	float mNrm = 1e-3f;
+	float mTgt = 1e-3f;
+	float mUV = 1e-5f;
+	float mClr = 1.0f / 512.0f;
+	float mWgt = 1.0f / 512.0f;
+};
+
+// CPU side model data as produced by importers.
+// Import stages work on it before GPU buffers are created, so they don't need a device.
+struct sModelSrc {
+	std::vector<sModelVtx> mVtx;
+	std::vector<sModelSrcGroup> mGroups;
+	sVtxWeldEps mWeldEps;
+	// Maximum number of simplified levels generated per group
+	uint32_t mLodNum = 3;
+	// Keep position and joint streams for depth passes next to the full vertices
+	bool mDepthStreams = true;
+	// Place vertices and indices in the shared buffers of cGeoHeap
+	bool mPooled = true;
+	// Triangle BVH for ray queries, see cTriBvh
+	bool mBvh = true;
+};
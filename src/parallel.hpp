@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+namespace nParallel {
+
+// Splits [0, count) into ranges of grain items and calls fn(begin, end) for
+// each of them on the standard library thread pool. Small inputs run inline.
+template <typename TFunc>
+void for_ranges(uint32_t count, uint32_t grain, TFunc&& fn) {
+	if (count == 0) { return; }
+	if (count <= grain) {
+		fn(0u, count);
+		return;
+	}
+
+	const uint32_t rangesNum = (count + grain - 1) / grain;
+	std::vector<uint32_t> ranges(rangesNum);
+	std::iota(ranges.begin(), ranges.end(), 0);
+	std::for_each(std::execution::par, ranges.begin(), ranges.end(), [&](uint32_t i) {
+		const uint32_t begin = i * grain;
+		fn(begin, std::min(begin + grain, count));
+	});
+}
+
+// Elements [mBegin, mEnd) of item mItem
+struct sChunk {
+	uint32_t mItem;
+	uint32_t mBegin;
+	uint32_t mEnd;
+};
+
+// Splits items of the given sizes into chunks of at most grain elements, in item order
+inline std::vector<sChunk> split_chunks(uint32_t const* pSizes, uint32_t num, uint32_t grain) {
+	std::vector<sChunk> chunks;
+	for (uint32_t i = 0; i < num; ++i) {
+		for (uint32_t begin = 0; begin < pSizes[i]; begin += grain) {
+			chunks.push_back({ i, begin, std::min(begin + grain, pSizes[i]) });
+		}
+	}
+	return chunks;
+}
+
+// Calls fn(index, chunk) for every chunk on the standard library thread pool
+template <typename TFunc>
+void for_chunks(std::vector<sChunk> const& chunks, TFunc&& fn) {
+	for_ranges((uint32_t)chunks.size(), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			fn(i, chunks[i]);
+		}
+	});
+}
+
+} // namespace nParallel
@@ -0,0 +1,359 @@
+#include "common.hpp"
+#include "range_alloc.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint32_t find_msb(uint32_t v) {
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanReverse(&idx, v);
+	return idx;
+#else
+	return 31 - __builtin_clz(v);
+#endif
+}
+
+static uint32_t find_lsb(uint32_t v) {
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, v);
+	return idx;
+#else
+	return __builtin_ctz(v);
+#endif
+}
+
+static uint32_t align_up(uint32_t offset, uint32_t align) {
+	return (offset + align - 1) & ~(align - 1);
+}
+
+// Sizes below SL_NUM map linearly to the first level, larger ones to SL_NUM
+// subdivisions of every power of 2
+static void size_class(uint32_t size, uint32_t slLog2, uint32_t& fl, uint32_t& sl) {
+	const uint32_t slNum = 1u << slLog2;
+	if (size < slNum) {
+		fl = 0;
+		sl = size;
+	} else {
+		const uint32_t msb = find_msb(size);
+		fl = msb - slLog2 + 1;
+		sl = (size >> (msb - slLog2)) ^ slNum;
+	}
+}
+
+uint32_t cRangeAllocator::new_block() {
+	uint32_t blk = mUnusedHead;
+	if (blk != INVALID) {
+		mUnusedHead = mBlocks[blk].mNextFree;
+	} else {
+		blk = (uint32_t)mBlocks.size();
+		mBlocks.emplace_back();
+	}
+	sBlock& b = mBlocks[blk];
+	b = {};
+	b.mAlign = 1;
+	b.mPrevPhys = b.mNextPhys = b.mPrevFree = b.mNextFree = INVALID;
+	b.mLive = true;
+	return blk;
+}
+
+void cRangeAllocator::delete_block(uint32_t blk) {
+	sBlock& b = mBlocks[blk];
+	b.mLive = false;
+	b.mNextFree = mUnusedHead;
+	mUnusedHead = blk;
+}
+
+void cRangeAllocator::insert_free(uint32_t blk) {
+	uint32_t fl, sl;
+	size_class(mBlocks[blk].mSize, SL_LOG2, fl, sl);
+	sBlock& b = mBlocks[blk];
+	b.mFree = true;
+	b.mPrevFree = INVALID;
+	b.mNextFree = mFreeHeads[fl][sl];
+	if (b.mNextFree != INVALID) {
+		mBlocks[b.mNextFree].mPrevFree = blk;
+	}
+	mFreeHeads[fl][sl] = blk;
+	mFLBitmap |= 1u << fl;
+	mSLBitmap[fl] |= 1u << sl;
+}
+
+void cRangeAllocator::remove_free(uint32_t blk) {
+	uint32_t fl, sl;
+	size_class(mBlocks[blk].mSize, SL_LOG2, fl, sl);
+	sBlock& b = mBlocks[blk];
+	if (b.mPrevFree != INVALID) {
+		mBlocks[b.mPrevFree].mNextFree = b.mNextFree;
+	} else {
+		mFreeHeads[fl][sl] = b.mNextFree;
+		if (b.mNextFree == INVALID) {
+			mSLBitmap[fl] &= ~(1u << sl);
+			if (!mSLBitmap[fl]) {
+				mFLBitmap &= ~(1u << fl);
+			}
+		}
+	}
+	if (b.mNextFree != INVALID) {
+		mBlocks[b.mNextFree].mPrevFree = b.mPrevFree;
+	}
+	b.mPrevFree = b.mNextFree = INVALID;
+	b.mFree = false;
+}
+
+uint32_t cRangeAllocator::find_free(uint32_t size) const {
+	// Rounded up to the next class, so any block of the class found fits
+	uint64_t rounded = size;
+	if (size >= SL_NUM) {
+		rounded += (1ull << (find_msb(size) - SL_LOG2)) - 1;
+	}
+	if (rounded > UINT32_MAX) { return INVALID; }
+
+	uint32_t fl, sl;
+	size_class((uint32_t)rounded, SL_LOG2, fl, sl);
+	uint32_t slMap = mSLBitmap[fl] & (~0u << sl);
+	if (!slMap) {
+		const uint32_t flMap = fl + 1 < 32 ? mFLBitmap & (~0u << (fl + 1)) : 0;
+		if (!flMap) { return INVALID; }
+		fl = find_lsb(flMap);
+		slMap = mSLBitmap[fl];
+	}
+	sl = find_lsb(slMap);
+	return mFreeHeads[fl][sl];
+}
+
+uint32_t cRangeAllocator::split(uint32_t blk, uint32_t size) {
+	if (mBlocks[blk].mSize <= size) { return INVALID; }
+
+	const uint32_t tail = new_block();
+	sBlock& b = mBlocks[blk];
+	sBlock& t = mBlocks[tail];
+	t.mOffset = b.mOffset + size;
+	t.mSize = b.mSize - size;
+	t.mPrevPhys = blk;
+	t.mNextPhys = b.mNextPhys;
+	if (b.mNextPhys != INVALID) {
+		mBlocks[b.mNextPhys].mPrevPhys = tail;
+	} else {
+		mLastPhys = tail;
+	}
+	b.mNextPhys = tail;
+	b.mSize = size;
+	return tail;
+}
+
+uint32_t cRangeAllocator::merge_free(uint32_t blk) {
+	const uint32_t prev = mBlocks[blk].mPrevPhys;
+	if (prev != INVALID && mBlocks[prev].mFree) {
+		remove_free(prev);
+		sBlock& p = mBlocks[prev];
+		sBlock const& b = mBlocks[blk];
+		p.mSize += b.mSize;
+		p.mNextPhys = b.mNextPhys;
+		if (b.mNextPhys != INVALID) {
+			mBlocks[b.mNextPhys].mPrevPhys = prev;
+		} else {
+			mLastPhys = prev;
+		}
+		delete_block(blk);
+		blk = prev;
+	}
+	const uint32_t next = mBlocks[blk].mNextPhys;
+	if (next != INVALID && mBlocks[next].mFree) {
+		remove_free(next);
+		sBlock& b = mBlocks[blk];
+		sBlock const& n = mBlocks[next];
+		b.mSize += n.mSize;
+		b.mNextPhys = n.mNextPhys;
+		if (n.mNextPhys != INVALID) {
+			mBlocks[n.mNextPhys].mPrevPhys = blk;
+		} else {
+			mLastPhys = blk;
+		}
+		delete_block(next);
+	}
+	return blk;
+}
+
+void cRangeAllocator::link_last(uint32_t blk) {
+	sBlock& b = mBlocks[blk];
+	b.mPrevPhys = mLastPhys;
+	b.mNextPhys = INVALID;
+	if (mLastPhys != INVALID) {
+		mBlocks[mLastPhys].mNextPhys = blk;
+	} else {
+		mFirstPhys = blk;
+	}
+	mLastPhys = blk;
+}
+
+void cRangeAllocator::add_free_range(uint32_t offset, uint32_t size) {
+	const uint32_t blk = new_block();
+	mBlocks[blk].mOffset = offset;
+	mBlocks[blk].mSize = size;
+	link_last(blk);
+	insert_free(blk);
+}
+
+void cRangeAllocator::reset(uint32_t capacity) {
+	mBlocks.clear();
+	mUnusedHead = INVALID;
+	mFirstPhys = mLastPhys = INVALID;
+	mFLBitmap = 0;
+	for (uint32_t fl = 0; fl < FL_NUM; ++fl) {
+		mSLBitmap[fl] = 0;
+		for (uint32_t sl = 0; sl < SL_NUM; ++sl) {
+			mFreeHeads[fl][sl] = INVALID;
+		}
+	}
+	mCapacity = capacity;
+	mUsed = 0;
+	mAllocs = 0;
+	if (capacity) {
+		add_free_range(0, capacity);
+	}
+}
+
+void cRangeAllocator::grow(uint32_t capacity) {
+	if (capacity <= mCapacity) { return; }
+
+	const uint32_t extra = capacity - mCapacity;
+	if (mLastPhys != INVALID && mBlocks[mLastPhys].mFree) {
+		const uint32_t last = mLastPhys;
+		remove_free(last);
+		mBlocks[last].mSize += extra;
+		insert_free(last);
+	} else {
+		add_free_range(mCapacity, extra);
+	}
+	mCapacity = capacity;
+}
+
+uint32_t cRangeAllocator::alloc(uint32_t size, uint32_t align/* = 1*/) {
+	if (size == 0 || align == 0 || (align & (align - 1))) { return INVALID; }
+
+	const uint64_t need = uint64_t(size) + align - 1;
+	if (need > UINT32_MAX) { return INVALID; }
+	uint32_t blk = find_free((uint32_t)need);
+	if (blk == INVALID) { return INVALID; }
+	remove_free(blk);
+
+	// Free neighbors are always merged, so the leftovers don't need merging
+	const uint32_t pad = align_up(mBlocks[blk].mOffset, align) - mBlocks[blk].mOffset;
+	if (pad) {
+		const uint32_t rest = split(blk, pad);
+		insert_free(blk);
+		blk = rest;
+	}
+	const uint32_t tail = split(blk, size);
+	if (tail != INVALID) {
+		insert_free(tail);
+	}
+
+	mBlocks[blk].mAlign = align;
+	mUsed += size;
+	mAllocs++;
+	return blk;
+}
+
+void cRangeAllocator::free(uint32_t handle) {
+	if (handle == INVALID) { return; }
+	sBlock& b = mBlocks[handle];
+	if (!b.mLive || b.mFree) { return; }
+
+	mUsed -= b.mSize;
+	mAllocs--;
+	b.mAlign = 1;
+	insert_free(merge_free(handle));
+}
+
+void cRangeAllocator::defrag(std::vector<sMove>& moves) {
+	std::vector<uint32_t> allocated;
+	allocated.reserve(mAllocs);
+	for (uint32_t blk = mFirstPhys; blk != INVALID;) {
+		const uint32_t next = mBlocks[blk].mNextPhys;
+		if (mBlocks[blk].mFree) {
+			remove_free(blk);
+			delete_block(blk);
+		} else {
+			allocated.push_back(blk);
+		}
+		blk = next;
+	}
+
+	mFirstPhys = mLastPhys = INVALID;
+	uint32_t cursor = 0;
+	for (uint32_t blk : allocated) {
+		const uint32_t offset = align_up(cursor, mBlocks[blk].mAlign);
+		if (offset > cursor) {
+			add_free_range(cursor, offset - cursor);
+		}
+		sBlock& b = mBlocks[blk];
+		if (offset != b.mOffset) {
+			moves.push_back({ b.mOffset, offset, b.mSize });
+			b.mOffset = offset;
+		}
+		link_last(blk);
+		cursor = offset + mBlocks[blk].mSize;
+	}
+	if (cursor < mCapacity) {
+		add_free_range(cursor, mCapacity - cursor);
+	}
+}
+
+cRangeAllocator::sStats cRangeAllocator::get_stats() const {
+	sStats stats;
+	stats.mCapacity = mCapacity;
+	stats.mUsed = mUsed;
+	stats.mAllocs = mAllocs;
+	for (uint32_t blk = mFirstPhys; blk != INVALID; blk = mBlocks[blk].mNextPhys) {
+		sBlock const& b = mBlocks[blk];
+		if (b.mFree) {
+			stats.mFreeBlocks++;
+			stats.mLargestFree = std::max(stats.mLargestFree, b.mSize);
+		}
+	}
+	return stats;
+}
+
+bool cRangeAllocator::validate() const {
+	uint32_t offset = 0;
+	uint32_t used = 0;
+	uint32_t allocs = 0;
+	uint32_t prev = INVALID;
+	for (uint32_t blk = mFirstPhys; blk != INVALID; blk = mBlocks[blk].mNextPhys) {
+		sBlock const& b = mBlocks[blk];
+		if (!b.mLive || b.mOffset != offset || b.mSize == 0 || b.mPrevPhys != prev) { return false; }
+		if (b.mFree) {
+			if (prev != INVALID && mBlocks[prev].mFree) { return false; }
+			uint32_t fl, sl;
+			size_class(b.mSize, SL_LOG2, fl, sl);
+			uint32_t itr = mFreeHeads[fl][sl];
+			while (itr != INVALID && itr != blk) {
+				itr = mBlocks[itr].mNextFree;
+			}
+			if (itr != blk) { return false; }
+		} else {
+			if (b.mOffset & (b.mAlign - 1)) { return false; }
+			used += b.mSize;
+			allocs++;
+		}
+		offset += b.mSize;
+		prev = blk;
+	}
+	if (prev != mLastPhys || offset != mCapacity || used != mUsed || allocs != mAllocs) { return false; }
+
+	for (uint32_t fl = 0; fl < FL_NUM; ++fl) {
+		for (uint32_t sl = 0; sl < SL_NUM; ++sl) {
+			const bool listed = mFreeHeads[fl][sl] != INVALID;
+			if (listed != !!(mSLBitmap[fl] & (1u << sl))) { return false; }
+			for (uint32_t itr = mFreeHeads[fl][sl]; itr != INVALID; itr = mBlocks[itr].mNextFree) {
+				if (!mBlocks[itr].mLive || !mBlocks[itr].mFree) { return false; }
+			}
+		}
+		if (!!mSLBitmap[fl] != !!(mFLBitmap & (1u << fl))) { return false; }
+	}
+	return true;
+}
@@ -0,0 +1,102 @@
+#include <vector>
+
+// Two level segregated fit allocator of ranges in an abstract address space.
+// It only does the offset bookkeeping, so it can back GPU buffers and be tested without a device.
+// Allocations are addressed by handles which stay valid across defragmentation.
+class cRangeAllocator {
+public:
+	static const uint32_t INVALID = UINT32_MAX;
+
+	struct sStats {
+		uint32_t mCapacity = 0;
+		uint32_t mUsed = 0;
+		uint32_t mAllocs = 0;
+		uint32_t mFreeBlocks = 0;
+		uint32_t mLargestFree = 0;
+
+		uint32_t get_free() const { return mCapacity - mUsed; }
+		// 0 when all free space is a single block, towards 1 when it is scattered
+		float get_fragmentation() const {
+			const uint32_t freeSize = get_free();
+			return freeSize ? 1.0f - float(mLargestFree) / freeSize : 0.0f;
+		}
+	};
+
+	// Range moved by defragmentation, sorted by destination
+	struct sMove {
+		uint32_t mSrc;
+		uint32_t mDst;
+		uint32_t mSize;
+	};
+
+private:
+	static const uint32_t SL_LOG2 = 4;
+	static const uint32_t SL_NUM = 1 << SL_LOG2;
+	static const uint32_t FL_NUM = 32 - SL_LOG2 + 1;
+
+	struct sBlock {
+		uint32_t mOffset;
+		uint32_t mSize;
+		uint32_t mAlign;
+		// Neighbors in address order
+		uint32_t mPrevPhys;
+		uint32_t mNextPhys;
+		// Links in the free list of the size class, or the next unused block
+		uint32_t mPrevFree;
+		uint32_t mNextFree;
+		bool mFree;
+		// False while in the list of unused blocks
+		bool mLive;
+	};
+
+	std::vector<sBlock> mBlocks;
+	uint32_t mUnusedHead = INVALID;
+	uint32_t mFirstPhys = INVALID;
+	uint32_t mLastPhys = INVALID;
+
+	uint32_t mFLBitmap = 0;
+	uint32_t mSLBitmap[FL_NUM] = {};
+	uint32_t mFreeHeads[FL_NUM][SL_NUM];
+
+	uint32_t mCapacity = 0;
+	uint32_t mUsed = 0;
+	uint32_t mAllocs = 0;
+
+	uint32_t new_block();
+	void delete_block(uint32_t blk);
+	void insert_free(uint32_t blk);
+	void remove_free(uint32_t blk);
+	uint32_t find_free(uint32_t size) const;
+	// Splits the tail after size off into a new block which is not in a free list yet.
+	// Returns INVALID when nothing is left.
+	uint32_t split(uint32_t blk, uint32_t size);
+	// Returns the merged block
+	uint32_t merge_free(uint32_t blk);
+	void link_last(uint32_t blk);
+	void add_free_range(uint32_t offset, uint32_t size);
+
+public:
+	cRangeAllocator() { reset(0); }
+	explicit cRangeAllocator(uint32_t capacity) { reset(capacity); }
+
+	// Drops all allocations
+	void reset(uint32_t capacity);
+	// Extends the address space at the end, handles stay valid
+	void grow(uint32_t capacity);
+
+	// align must be a power of 2. Returns INVALID when no free range fits.
+	uint32_t alloc(uint32_t size, uint32_t align = 1);
+	void free(uint32_t handle);
+
+	uint32_t get_offset(uint32_t handle) const { return mBlocks[handle].mOffset; }
+	uint32_t get_size(uint32_t handle) const { return mBlocks[handle].mSize; }
+	uint32_t get_capacity() const { return mCapacity; }
+
+	// Packs all allocations towards offset 0 keeping their order and alignment.
+	// Moves are appended in increasing offset order, every destination is at or below its source.
+	void defrag(std::vector<sMove>& moves);
+
+	sStats get_stats() const;
+	// Checks links, bitmaps and sizes, for tests
+	bool validate() const;
+};
@@ -48,6 +48,26 @@ void cBufferBase::init_write_only(ID3D11Device* pDev, uint32_t size, D3D11_BIND_
 	if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateBuffer mutable write-only failed");
 }
 
+void cBufferBase::init_default(ID3D11Device* pDev, uint32_t size, D3D11_BIND_FLAG bind) {
+	auto desc = D3D11_BUFFER_DESC();
+	desc.ByteWidth = size;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = bind;
+
+	HRESULT hr = pDev->CreateBuffer(&desc, nullptr, mpBuf.pp());
+	if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateBuffer default failed");
+}
+
+void cBufferBase::update_range(ID3D11DeviceContext* pCtx, void const* pData, uint32_t offset, uint32_t size) {
+	D3D11_BOX box = { offset, 0, 0, offset + size, 1, 1 };
+	pCtx->UpdateSubresource(mpBuf, 0, &box, pData, 0, 0);
+}
+
+void cBufferBase::copy_range(ID3D11DeviceContext* pCtx, cBufferBase const& src, uint32_t srcOffset, uint32_t dstOffset, uint32_t size) {
+	D3D11_BOX box = { srcOffset, 0, 0, srcOffset + size, 1, 1 };
+	pCtx->CopySubresourceRegion(mpBuf, 0, dstOffset, 0, 0, src.mpBuf, 0, &box);
+}
+
 void cConstBufferBase::init(ID3D11Device* pDev, size_t size) {
 	init_write_only(pDev, (uint32_t)size, D3D11_BIND_CONSTANT_BUFFER);
 }
@@ -71,6 +91,12 @@ void cVertexBuffer::init_write_only(ID3D11Device* pDev, uint32_t vtxCount, uint3
 	mVtxCount = vtxCount;
 }
 
+void cVertexBuffer::init_default(ID3D11Device* pDev, uint32_t vtxCount, uint32_t vtxSize) {
+	cBufferBase::init_default(pDev, vtxCount * vtxSize, D3D11_BIND_VERTEX_BUFFER);
+	mVtxSize = vtxSize;
+	mVtxCount = vtxCount;
+}
+
 void cVertexBuffer::set(ID3D11DeviceContext* pCtx, uint32_t slot, uint32_t offset) const {
 	pCtx->IASetVertexBuffers(slot, 1, &mpBuf.p, &mVtxSize, &offset);
 }
@@ -101,10 +127,27 @@ void cIndexBuffer::init_write_only(ID3D11Device* pDev, uint32_t idxCount, DXGI_F
 	mIdxCount = idxCount;
 }
 
+void cIndexBuffer::init_default(ID3D11Device* pDev, uint32_t idxCount, DXGI_FORMAT format) {
+	uint32_t size = 0;
+	switch (format) {
+	case DXGI_FORMAT_R16_UINT: size = 2 * idxCount; break;
+	case DXGI_FORMAT_R32_UINT: size = 4 * idxCount; break;
+	default: throw sD3DException(E_NOTIMPL, "cIndexBuffer unable to select size from provided format");
+	}
+
+	cBufferBase::init_default(pDev, size, D3D11_BIND_INDEX_BUFFER);
+	mFormat = format;
+	mIdxCount = idxCount;
+}
+
 void cIndexBuffer::set(ID3D11DeviceContext* pCtx, uint32_t offset) const {
 	pCtx->IASetIndexBuffer(mpBuf, mFormat, offset);
 }
 
+void cIndexBuffer::set(ID3D11DeviceContext* pCtx, uint32_t offset, DXGI_FORMAT format) const {
+	pCtx->IASetIndexBuffer(mpBuf, format, offset);
+}
+
 
 cSamplerStates::cSamplerStates(ID3D11Device* pDev) {
 	HRESULT hr;
@@ -60,9 +60,33 @@ struct sTestMtlCBuf {
 	void serialize(Archive& arc);
 };
 
+// Affine skin matrix without the constant (0,0,0,1) column.
+// Stored transposed as 3 rows, which matches row_major float3x4 in hlsl.
+struct sSkinMtx {
+	DirectX::XMVECTOR r[3];
+};
+
 struct sSkinCBuf {
-	enum { MAX_SKIN_MTX = 64 };
-	DirectX::XMMATRIX skin[MAX_SKIN_MTX];
+	// Same 4KB as 64 full matrices
+	enum { MAX_SKIN_MTX = 85 };
+	sSkinMtx skin[MAX_SKIN_MTX];
+};
+
+// Unit dual quaternion, dual part is 0.5 * translation * real.
+// Skins in model space, world transform is applied from sMeshCBuf.
+struct sSkinDQ {
+	DirectX::XMVECTOR real;
+	DirectX::XMVECTOR dual;
+};
+
+struct sSkinDQCBuf {
+	enum { MAX_SKIN_DQ = 128 };
+	sSkinDQ skin[MAX_SKIN_DQ];
+};
+
+enum eSkinPalette : uint32_t {
+	E_SKIN_PALETTE_MTX = 1 << 0,
+	E_SKIN_PALETTE_DQ = 1 << 1,
 };
 
 class cBufferBase : noncopyable {
@@ -104,6 +128,10 @@ public:
 
 	cMapHandle map(ID3D11DeviceContext* pCtx);
 
+	// Default usage buffers only
+	void update_range(ID3D11DeviceContext* pCtx, void const* pData, uint32_t offset, uint32_t size);
+	void copy_range(ID3D11DeviceContext* pCtx, cBufferBase const& src, uint32_t srcOffset, uint32_t dstOffset, uint32_t size);
+
 protected:
 	void init_immutable(ID3D11Device* pDev,
 		void const* pData, uint32_t size,
@@ -111,6 +139,9 @@ protected:
 
 	void init_write_only(ID3D11Device* pDev, 
 		uint32_t size, D3D11_BIND_FLAG bind);
+
+	void init_default(ID3D11Device* pDev,
+		uint32_t size, D3D11_BIND_FLAG bind);
 };
 
 class cConstBufferBase : public cBufferBase {
@@ -141,6 +172,12 @@ public:
 	void update(ID3D11DeviceContext* pCtx) {
 		cConstBufferBase::update(pCtx, &mData, sizeof(T));
 	}
+
+	// Uploads prepared data directly, bypassing mData
+	void update(ID3D11DeviceContext* pCtx, void const* pData, size_t size) {
+		assert(size <= sizeof(T));
+		cConstBufferBase::update(pCtx, pData, size);
+	}
 };
 
 template <typename T, int slot>
@@ -168,6 +205,8 @@ public:
 
 	void init(ID3D11Device* pDev, void const* pVtxData, uint32_t vtxCount, uint32_t vtxSize);
 	void init_write_only(ID3D11Device* pDev, uint32_t vtxCount, uint32_t vtxSize);
+	// GPU writable, filled with update_range
+	void init_default(ID3D11Device* pDev, uint32_t vtxCount, uint32_t vtxSize);
 
 	void set(ID3D11DeviceContext* pCtx, uint32_t slot, uint32_t offset) const;
 
@@ -189,7 +228,10 @@ public:
 
 	void init(ID3D11Device* pDev, void const* pIdxData, uint32_t idxCount, DXGI_FORMAT format);
 	void init_write_only(ID3D11Device* pDev, uint32_t idxCount, DXGI_FORMAT format);
+	void init_default(ID3D11Device* pDev, uint32_t idxCount, DXGI_FORMAT format);
 	void set(ID3D11DeviceContext* pCtx, uint32_t offset) const;
+	// For buffers holding ranges of different index formats
+	void set(ID3D11DeviceContext* pCtx, uint32_t offset, DXGI_FORMAT format) const;
 
 	uint32_t get_idx_count() const { return mIdxCount; }
 };
@@ -202,6 +244,7 @@ public:
 	cConstBufferSlotted<sTestMtlCBuf, 2> mTestMtlCBuf;
 	cConstBufferSlotted<sLightCBuf, 3> mLightCBuf;
 	cConstBufferSlotted<sSkinCBuf, 4> mSkinCBuf;
+	cConstBufferSlotted<sSkinDQCBuf, 5> mSkinDQCBuf;
 
 	cConstBufStorage() = default;
 	cConstBufStorage(ID3D11Device* pDev) { init(pDev); }
@@ -213,6 +256,7 @@ public:
 		mTestMtlCBuf.init(pDev);
 		mLightCBuf.init(pDev);
 		mSkinCBuf.init(pDev);
+		mSkinDQCBuf.init(pDev);
 	}
 
 	static cConstBufStorage& get_global();
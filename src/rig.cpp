@@ -1,6 +1,7 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <malloc.h>
 
 #include "math.hpp"
 #include "common.hpp"
@@ -8,6 +9,7 @@
 #include "rig.hpp"
 #include "rdr.hpp"
 #include "assimp_loader.hpp"
+#include "skin.hpp"
 
 CLANG_DIAG_PUSH
 CLANG_DIAG_IGNORE("-Wpragma-pack")
@@ -221,16 +223,144 @@ bool cRigData::load(cAssimpLoader& loader) {
 }
 
 
+static size_t align_offset(size_t offset, size_t alignment) {
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+cRigPool::cRigPool(cRigData const& rigData) {
+	const size_t jointsNum = rigData.get_joints_num();
+	const size_t skinNum = rigData.get_skin_num();
+
+	size_t offset = 0;
+	auto place = [&offset](size_t size) {
+		const size_t res = offset;
+		offset = align_offset(offset + size, ALIGNMENT);
+		return res;
+	};
+	mLayout.mLMtx = place(sizeof(DirectX::XMMATRIX) * jointsNum);
+	mLayout.mWMtx = place(sizeof(DirectX::XMMATRIX) * jointsNum);
+	mLayout.mXforms = place(sizeof(sXform) * jointsNum);
+	mLayout.mSkin = place(sizeof(sSkinMtx) * skinNum * cRig::SKIN_BUFFERS_NUM);
+	mLayout.mJoints = place(sizeof(cJoint) * jointsNum);
+	mLayout.mDirty = place(sizeof(uint8_t) * jointsNum);
+	mLayout.mSize = std::max<size_t>(offset, ALIGNMENT);
+}
+
+cRigPool::~cRigPool() {
+	assert(mLive.empty());
+	for (auto pSlab : mSlabs) {
+		::_aligned_free(pSlab);
+	}
+}
+
+void cRigPool::grow() {
+	auto pSlab = static_cast<uint8_t*>(::_aligned_malloc(mLayout.mSize * SLAB_SIZE, ALIGNMENT));
+	if (!pSlab) { throw std::bad_alloc(); }
+	mSlabs.push_back(pSlab);
+
+	const uint32_t first = (uint32_t)mGen.size();
+	const uint32_t capacity = first + SLAB_SIZE;
+	mGen.resize(capacity, 0);
+	mOwners.resize(capacity, nullptr);
+	mLivePos.resize(capacity, UINT32_MAX);
+	mFree.reserve(capacity);
+	mLive.reserve(capacity);
+	// Lower slots are taken first
+	for (uint32_t slot = capacity; slot > first; --slot) {
+		mFree.push_back(slot - 1);
+	}
+}
+
+void cRigPool::reserve(uint32_t num) {
+	while (mGen.size() < num) {
+		grow();
+	}
+}
+
+cRigPool::sHandle cRigPool::acquire(cRig* pOwner) {
+	if (mFree.empty()) {
+		grow();
+	}
+	const uint32_t slot = mFree.back();
+	mFree.pop_back();
+
+	mOwners[slot] = pOwner;
+	mLivePos[slot] = (uint32_t)mLive.size();
+	mLive.push_back(slot);
+
+	sHandle handle;
+	handle.mIdx = slot;
+	handle.mGen = mGen[slot];
+	return handle;
+}
+
+void cRigPool::release(sHandle handle) {
+	if (!get_mem(handle)) { return; }
+	const uint32_t slot = handle.mIdx;
+
+	// Swap-remove keeps live instances dense
+	const uint32_t pos = mLivePos[slot];
+	const uint32_t last = mLive.back();
+	mLive[pos] = last;
+	mLivePos[last] = pos;
+	mLive.pop_back();
+
+	mLivePos[slot] = UINT32_MAX;
+	mOwners[slot] = nullptr;
+	++mGen[slot];
+	mFree.push_back(slot);
+}
+
+uint8_t* cRigPool::get_mem(sHandle handle) const {
+	if (!handle.is_valid() || handle.mIdx >= mGen.size()) { return nullptr; }
+	if (mGen[handle.mIdx] != handle.mGen || !mOwners[handle.mIdx]) { return nullptr; }
+	return slot_mem(handle.mIdx);
+}
+
+cRig* cRigPool::get(sHandle handle) const {
+	return get_mem(handle) ? mOwners[handle.mIdx] : nullptr;
+}
+
+cRigPool& cRigData::get_pool() const {
+	if (!mpPool) {
+		mpPool = std::make_unique<cRigPool>(*this);
+	}
+	return *mpPool;
+}
+
+
+cRig::cRig() : mSkinPalettes(E_SKIN_PALETTE_MTX) {}
+
+cRig::~cRig() {
+	deinit();
+}
+
 void cRig::init(cRigData const* pRigData) {
 	if (!pRigData) { return; }
-	
+	deinit();
+
+	auto& pool = pRigData->get_pool();
+	auto const& layout = pool.get_layout();
+	const cRigPool::sHandle handle = pool.acquire(this);
+	uint8_t* pMem = pool.get_mem(handle);
+
 	const int jointsNum = pRigData->mJointsNum;
-	auto pLMtx = std::make_unique<DirectX::XMMATRIX[]>(jointsNum);
-	auto pWMtx = std::make_unique<DirectX::XMMATRIX[]>(jointsNum);
-	auto pJoints = std::make_unique<cJoint[]>(jointsNum);
-	auto pXforms = std::make_unique<sXform[]>(jointsNum);
+	const int skinNum = pRigData->mIMtxNum;
+	auto pLMtx = reinterpret_cast<DirectX::XMMATRIX*>(pMem + layout.mLMtx);
+	auto pWMtx = reinterpret_cast<DirectX::XMMATRIX*>(pMem + layout.mWMtx);
+	auto pXforms = reinterpret_cast<sXform*>(pMem + layout.mXforms);
+	auto pDirty = reinterpret_cast<eDirtyFlags*>(pMem + layout.mDirty);
+	auto pSkin = reinterpret_cast<sSkinMtx*>(pMem + layout.mSkin);
+	// All slot types are trivially destructible except for cJoint defaults, construct it in place
+	auto pJoints = reinterpret_cast<cJoint*>(pMem + layout.mJoints);
+	for (int i = 0; i < jointsNum; ++i) {
+		::new(&pJoints[i]) cJoint();
+	}
+	for (int i = 0; i < skinNum * SKIN_BUFFERS_NUM; ++i) {
+		pSkin[i] = { { DirectX::g_XMIdentityR0, DirectX::g_XMIdentityR1, DirectX::g_XMIdentityR2 } };
+	}
 
-	::memcpy(pLMtx.get(), pRigData->mpLMtx.get(), sizeof(pRigData->mpLMtx[0]) * jointsNum);
+	::memcpy(pLMtx, pRigData->mpLMtx.get(), sizeof(pRigData->mpLMtx[0]) * jointsNum);
 
 	for (int i = 0; i < jointsNum; ++i) {
 		auto const& jdata = pRigData->mpJoints[i];
@@ -242,8 +372,11 @@ void cRig::init(cRigData const* pRigData) {
 		jnt.mpXform = &pXforms[i];
 		jnt.mpLMtx = &pLMtx[i];
 		jnt.mpWMtx = &pWMtx[i];
+		jnt.mpRig = this;
+		jnt.mIdx = i;
 		
 		jnt.mpXform->init(*jnt.mpLMtx);
+		pDirty[i] = eDirtyWorld;
 
 		if (jdata.skinIdx >= 0) {
 			jnt.mpIMtx = &pRigData->mpIMtx[jdata.skinIdx];
@@ -258,44 +391,239 @@ void cRig::init(cRigData const* pRigData) {
 	
 	mJointsNum = jointsNum;
 	mpRigData = pRigData;
-	mpJoints = std::move(pJoints);
-	mpLMtx = std::move(pLMtx);
-	mpWmtx = std::move(pWMtx);
-	mpXforms = std::move(pXforms);
+	mHandle = handle;
+	mpJoints = pJoints;
+	mpLMtx = pLMtx;
+	mpWmtx = pWMtx;
+	mpXforms = pXforms;
+	mpDirty = pDirty;
+	mDirtyLocal = false;
+	mDirtyWorld = true;
+	mSkinNum = skinNum;
+	mSkinFront = 0;
+	mpSkin = pSkin;
+	mpSkinDQ.reset();
+	mpSkinModel.reset();
+	if (mSkinPalettes & E_SKIN_PALETTE_DQ) {
+		alloc_skin_dq();
+	}
 
 	calc_world();
+	calc_skin();
+}
+
+void cRig::deinit() {
+	if (!mpRigData) { return; }
+
+	mpRigData->get_pool().release(mHandle);
+	mHandle = cRigPool::sHandle();
+	mpRigData = nullptr;
+	mJointsNum = 0;
+	mpJoints = nullptr;
+	mpLMtx = nullptr;
+	mpWmtx = nullptr;
+	mpXforms = nullptr;
+	mpDirty = nullptr;
+	mSkinNum = 0;
+	mpSkin = nullptr;
+	mpSkinDQ.reset();
+	mpSkinModel.reset();
 }
 
 void cRig::calc_local() {
+	if (!mDirtyLocal) { return; }
+
 	for (int i = 0; i < mJointsNum; ++i) {
-		mpJoints[i].calc_local();
+		auto& flags = mpDirty[i];
+		if (nFlag::check(flags, eDirtyLocal)) {
+			mpJoints[i].calc_local();
+			nFlag::reset(flags, eDirtyLocal);
+			nFlag::set(flags, eDirtyWorld);
+		}
 	}
+
+	mDirtyLocal = false;
+	mDirtyWorld = true;
 }
 
 void cRig::calc_world() {
+	mWorldChanged = false;
+	if (!mDirtyWorld) { return; }
+
+	// Joints are sorted so that parent always goes before its children, so
+	// eWorldUpdated of the parent is already set for this pass when a child is visited.
 	for (int i = 0; i < mJointsNum; ++i) {
-		mpJoints[i].calc_world();
+		auto& flags = mpDirty[i];
+		const int parIdx = mpRigData->mpJoints[i].parIdx;
+		const bool dirty = nFlag::check(flags, eDirtyWorld)
+			|| (parIdx >= 0 && nFlag::check(mpDirty[parIdx], eWorldUpdated));
+
+		nFlag::reset(flags, eDirtyFlags(eDirtyWorld | eWorldUpdated));
+		if (dirty) {
+			mpJoints[i].calc_world();
+			nFlag::set(flags, eWorldUpdated);
+			mWorldChanged = true;
+		}
 	}
+
+	mDirtyWorld = false;
 }
 
-void cRig::upload_skin(cRdrContext const& rdrCtx) const {
-	auto& skinCBuf = rdrCtx.get_cbufs().mSkinCBuf;
+void cRig::mark_local_dirty(int idx) {
+	nFlag::set(mpDirty[idx], eDirtyLocal);
+	mDirtyLocal = true;
+}
 
-	auto* pSkin = skinCBuf.mData.skin;
+void cRig::mark_world_dirty(int idx) {
+	nFlag::set(mpDirty[idx], eDirtyWorld);
+	mDirtyWorld = true;
+}
 
+void cRig::mark_all_dirty() {
 	for (int i = 0; i < mJointsNum; ++i) {
-		auto pImtx = mpJoints[i].get_inv_mtx();
-		if (!pImtx) { continue; }
-		int skinIdx = mpRigData->mpJoints[i].skinIdx;
+		nFlag::set(mpDirty[i], eDirtyWorld);
+	}
+	mDirtyWorld = true;
+}
+
+void cRig::calc_skin() {
+	if (!mWorldChanged) { return; }
+
+	const int back = mSkinFront ^ 1;
+
+	if (mSkinPalettes & E_SKIN_PALETTE_MTX) {
+		auto* pSkin = &mpSkin[back * mSkinNum];
 
-		auto const& pWmtx = mpJoints[i].get_world_mtx();
+		for (int i = 0; i < mJointsNum; ++i) {
+			auto pImtx = mpJoints[i].get_inv_mtx();
+			if (!pImtx) { continue; }
+			int skinIdx = mpRigData->mpJoints[i].skinIdx;
+
+			auto const& pWmtx = mpJoints[i].get_world_mtx();
+
+			// Last row of the transposed affine matrix is always (0,0,0,1), drop it
+			const DirectX::XMMATRIX skinT = DirectX::XMMatrixMultiplyTranspose(*pImtx, pWmtx);
+			auto& skin = pSkin[skinIdx];
+			skin.r[0] = skinT.r[0];
+			skin.r[1] = skinT.r[1];
+			skin.r[2] = skinT.r[2];
+		}
+	}
+
+	if ((mSkinPalettes & E_SKIN_PALETTE_DQ) && mJointsNum > 0) {
+		// Dual quaternions can't hold the model scale, so they are built in model space
+		// and the shader applies the world matrix afterwards.
+		const DirectX::XMMATRIX invRoot = DirectX::XMMatrixInverse(nullptr, *mpJoints[0].mpParentMtx);
+		auto* pModel = mpSkinModel.get();
+
+		for (int i = 0; i < mJointsNum; ++i) {
+			auto pImtx = mpJoints[i].get_inv_mtx();
+			if (!pImtx) { continue; }
+			int skinIdx = mpRigData->mpJoints[i].skinIdx;
+
+			const DirectX::XMMATRIX modelMtx = mpJoints[i].get_world_mtx() * invRoot;
+			const DirectX::XMMATRIX skinT = DirectX::XMMatrixMultiplyTranspose(*pImtx, modelMtx);
+			auto& skin = pModel[skinIdx];
+			skin.r[0] = skinT.r[0];
+			skin.r[1] = skinT.r[1];
+			skin.r[2] = skinT.r[2];
+		}
 
-		pSkin[skinIdx] = (*pImtx) * pWmtx;
+		nSkin::mtx_to_dq(pModel, &mpSkinDQ[back * mSkinNum], mSkinNum);
 	}
 
+	mSkinFront = back;
+}
+
+void cRig::upload_skin(cRdrContext const& rdrCtx) const {
+	auto& cbufs = rdrCtx.get_cbufs();
+	auto pCtx = rdrCtx.get_ctx();
+
+	if (mSkinPalettes & E_SKIN_PALETTE_MTX) {
+		const int num = std::min(mSkinNum, (int)sSkinCBuf::MAX_SKIN_MTX);
+		cbufs.mSkinCBuf.update(pCtx, get_skin(), num * sizeof(sSkinMtx));
+		cbufs.mSkinCBuf.set_VS(pCtx);
+	}
+
+	if (mSkinPalettes & E_SKIN_PALETTE_DQ) {
+		const int num = std::min(mSkinNum, (int)sSkinDQCBuf::MAX_SKIN_DQ);
+		cbufs.mSkinDQCBuf.update(pCtx, get_skin_dq(), num * sizeof(sSkinDQ));
+		cbufs.mSkinDQCBuf.set_VS(pCtx);
+	}
+}
+
+void cRig::upload_skin(cRdrContext const& rdrCtx, uint16_t const* pJnt, uint32_t num) const {
+	auto& cbufs = rdrCtx.get_cbufs();
 	auto pCtx = rdrCtx.get_ctx();
-	skinCBuf.update(pCtx);
-	skinCBuf.set_VS(pCtx);
+
+	if (mSkinPalettes & E_SKIN_PALETTE_MTX) {
+		assert(num <= sSkinCBuf::MAX_SKIN_MTX);
+		auto const* pSkin = get_skin();
+		auto& cbuf = cbufs.mSkinCBuf;
+		for (uint32_t i = 0; i < num; ++i) {
+			cbuf.mData.skin[i] = pSkin[pJnt[i]];
+		}
+		cbuf.update(pCtx, cbuf.mData.skin, num * sizeof(sSkinMtx));
+		cbuf.set_VS(pCtx);
+	}
+
+	if (mSkinPalettes & E_SKIN_PALETTE_DQ) {
+		assert(num <= sSkinDQCBuf::MAX_SKIN_DQ);
+		auto const* pSkinDQ = get_skin_dq();
+		auto& cbuf = cbufs.mSkinDQCBuf;
+		for (uint32_t i = 0; i < num; ++i) {
+			cbuf.mData.skin[i] = pSkinDQ[pJnt[i]];
+		}
+		cbuf.update(pCtx, cbuf.mData.skin, num * sizeof(sSkinDQ));
+		cbuf.set_VS(pCtx);
+	}
+}
+
+void cRig::set_skin_palettes(uint32_t palettes) {
+	mSkinPalettes = palettes;
+	if ((mSkinPalettes & E_SKIN_PALETTE_DQ) && !mpSkinDQ && mpRigData) {
+		alloc_skin_dq();
+	}
+	mark_all_dirty();
+}
+
+void cRig::alloc_skin_dq() {
+	const int skinNum = mpRigData->mIMtxNum;
+	auto pSkinDQ = std::make_unique<sSkinDQ[]>(skinNum * SKIN_BUFFERS_NUM);
+	auto pSkinModel = std::make_unique<sSkinMtx[]>(skinNum);
+	for (int i = 0; i < skinNum * SKIN_BUFFERS_NUM; ++i) {
+		pSkinDQ[i] = { DirectX::g_XMIdentityR3, DirectX::g_XMZero };
+	}
+	for (int i = 0; i < skinNum; ++i) {
+		pSkinModel[i] = { { DirectX::g_XMIdentityR0, DirectX::g_XMIdentityR1, DirectX::g_XMIdentityR2 } };
+	}
+	mpSkinDQ = std::move(pSkinDQ);
+	mpSkinModel = std::move(pSkinModel);
+}
+
+sSkinMtx const* cRig::get_skin() const {
+	return &mpSkin[mSkinFront * mSkinNum];
+}
+
+sSkinDQ const* cRig::get_skin_dq() const {
+	return &mpSkinDQ[mSkinFront * mSkinNum];
+}
+
+sAABB cRig::calc_skinned_aabb(sAABB const* pBindBounds, uint32_t boundsNum) const {
+	sAABB res;
+	res.init_empty();
+	for (int i = 0; i < mJointsNum; ++i) {
+		auto pImtx = mpJoints[i].get_inv_mtx();
+		if (!pImtx) { continue; }
+		const int skinIdx = mpRigData->mpJoints[i].skinIdx;
+		if (skinIdx >= (int)boundsNum) { continue; }
+		auto const& bindBox = pBindBounds[skinIdx];
+		if (bindBox.is_empty()) { continue; }
+
+		const DirectX::XMMATRIX skin = DirectX::XMMatrixMultiply(*pImtx, mpJoints[i].get_world_mtx());
+		res.add(bindBox.transform(skin));
+	}
+	return res;
 }
 
 cJoint* cRig::get_joint(int idx) const {
@@ -316,6 +644,13 @@ cJoint* cRig::find_joint(cstr name) const {
 
 
 
+void cJoint::set_parent_mtx(DirectX::XMMATRIX* pMtx) {
+	mpParentMtx = pMtx;
+	if (mpRig) {
+		mpRig->mark_world_dirty(mIdx);
+	}
+}
+
 void cJoint::calc_world() {
 	(*mpWMtx) = (*mpLMtx) * (*mpParentMtx);
 }
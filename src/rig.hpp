@@ -1,5 +1,79 @@
 class cAssimpLoader;
 class cRdrContext;
+struct sSkinMtx;
+struct sSkinDQ;
+
+class cRig;
+class cRigData;
+
+// Contiguous storage of rig instances sharing one cRigData.
+// Instance state is carved from aligned slabs of SLAB_SIZE instances.
+// acquire/release are O(1) through a free list, memory is only allocated
+// when the pool grows by a whole slab.
+class cRigPool : noncopyable {
+public:
+	enum {
+		SLAB_SIZE = 32,
+		ALIGNMENT = 64,
+	};
+
+	struct sHandle {
+		uint32_t mIdx = UINT32_MAX;
+		uint32_t mGen = 0;
+
+		bool is_valid() const { return mIdx != UINT32_MAX; }
+	};
+
+	// Byte offsets of the instance arrays inside a slot
+	struct sLayout {
+		size_t mJoints;
+		size_t mLMtx;
+		size_t mWMtx;
+		size_t mXforms;
+		size_t mDirty;
+		size_t mSkin;
+		size_t mSize;
+	};
+
+private:
+	sLayout mLayout;
+	std::vector<uint8_t*> mSlabs;
+	// Per slot
+	std::vector<uint32_t> mGen;
+	std::vector<cRig*> mOwners;
+	std::vector<uint32_t> mLivePos;
+	// Reserved for the whole capacity on growth, so never reallocate on acquire/release
+	std::vector<uint32_t> mFree;
+	std::vector<uint32_t> mLive;
+
+public:
+	explicit cRigPool(cRigData const& rigData);
+	~cRigPool();
+
+	sHandle acquire(cRig* pOwner);
+	void release(sHandle handle);
+	void reserve(uint32_t num);
+
+	// nullptr for released handles
+	uint8_t* get_mem(sHandle handle) const;
+	cRig* get(sHandle handle) const;
+	sLayout const& get_layout() const { return mLayout; }
+	uint32_t get_count() const { return (uint32_t)mLive.size(); }
+
+	// Visits live instances, for batched updates
+	template <typename TFunc>
+	void for_each(TFunc&& fn) const {
+		for (uint32_t slot : mLive) {
+			fn(*mOwners[slot]);
+		}
+	}
+
+private:
+	void grow();
+	uint8_t* slot_mem(uint32_t slot) const {
+		return mSlabs[slot / SLAB_SIZE] + (slot % SLAB_SIZE) * mLayout.mSize;
+	}
+};
 
 struct sJointData {
 	int idx;
@@ -14,12 +88,18 @@ class cRigData : public noncopyable {
 	std::unique_ptr<DirectX::XMMATRIX[]> mpLMtx;
 	std::unique_ptr<DirectX::XMMATRIX[]> mpIMtx;
 	std::unique_ptr<std::string[]> mpNames;
+	// Created on the first cRig::init, after the data is loaded
+	mutable std::unique_ptr<cRigPool> mpPool;
 
 public:
 	bool load(const fs::path& filepath);
 	bool load(cAssimpLoader& loader);
 	
 	int find_joint_idx(cstr name) const;
+	int get_joints_num() const { return mJointsNum; }
+	int get_skin_num() const { return mIMtxNum; }
+
+	cRigPool& get_pool() const;
 private:
 
 	bool load_json(const fs::path& filepath);
@@ -36,15 +116,19 @@ class cJoint {
 	DirectX::XMMATRIX* mpWMtx = nullptr;
 	DirectX::XMMATRIX const* mpIMtx = nullptr;
 	DirectX::XMMATRIX const* mpParentMtx = nullptr;
+	cRig* mpRig = nullptr;
+	int mIdx = -1;
 
 public:
 	DirectX::XMMATRIX& get_local_mtx() { return *mpLMtx; }
 	DirectX::XMMATRIX& get_world_mtx() { return *mpWMtx; }
 	DirectX::XMMATRIX const* get_inv_mtx() { return mpIMtx; }
 	//void set_inv_mtx(DirectX::XMMATRIX* pMtx) { mpIMtx = pMtx; }
-	void set_parent_mtx(DirectX::XMMATRIX* pMtx) { mpParentMtx = pMtx; }
+	void set_parent_mtx(DirectX::XMMATRIX* pMtx);
 
-	sXform& get_xform() { return *mpXform; }
+	sXform const& get_xform() const { return *mpXform; }
+	// Marks the joint as dirty, so only changed subtrees are recalculated
+	inline sXform& edit_xform();
 
 	void calc_local();
 	void calc_world();
@@ -53,24 +137,79 @@ private:
 	friend class cRig;
 };
 
-class cRig {
+class cRig : noncopyable {
+	enum eDirtyFlags : uint8_t {
+		eDirtyLocal = 1 << 0,
+		eDirtyWorld = 1 << 1,
+		eWorldUpdated = 1 << 2,
+	};
+
 	int mJointsNum = 0;
-	std::unique_ptr<cJoint[]> mpJoints;
 	cRigData const* mpRigData = nullptr;
-	std::unique_ptr<DirectX::XMMATRIX[]> mpLMtx;
-	std::unique_ptr<DirectX::XMMATRIX[]> mpWmtx;
-	std::unique_ptr<sXform[]> mpXforms;
+	// Instance state lives in the cRigData pool slot
+	cRigPool::sHandle mHandle;
+	cJoint* mpJoints = nullptr;
+	DirectX::XMMATRIX* mpLMtx = nullptr;
+	DirectX::XMMATRIX* mpWmtx = nullptr;
+	sXform* mpXforms = nullptr;
+	eDirtyFlags* mpDirty = nullptr;
+	bool mDirtyLocal = false;
+	bool mDirtyWorld = false;
+	bool mWorldChanged = false;
+
+	// Skin palette is double-buffered: calc_skin() fills the back buffer in update phase
+	// while render jobs of the previous frame may still read the front one.
+	enum { SKIN_BUFFERS_NUM = 2 };
+	int mSkinNum = 0;
+	int mSkinFront = 0;
+	sSkinMtx* mpSkin = nullptr;
+	// eSkinPalette mask
+	uint32_t mSkinPalettes;
+	std::unique_ptr<sSkinDQ[]> mpSkinDQ;
+	std::unique_ptr<sSkinMtx[]> mpSkinModel;
 public:
 
+	cRig();
+	~cRig();
+
 	void init(cRigData const* pRigData);
+	void deinit();
 
 	void calc_local();
 	void calc_world();
 
+	void mark_local_dirty(int idx);
+	void mark_world_dirty(int idx);
+	void mark_all_dirty();
+	// True if the last calc_world() has updated any world matrix
+	bool is_world_changed() const { return mWorldChanged; }
+
+	void calc_skin();
 	void upload_skin(cRdrContext const& rdrCtx) const;
+	// Uploads the subset of joints referenced by a skin partition
+	void upload_skin(cRdrContext const& rdrCtx, uint16_t const* pJnt, uint32_t num) const;
+
+	void set_skin_palettes(uint32_t palettes);
+	uint32_t get_skin_palettes() const { return mSkinPalettes; }
+	sSkinMtx const* get_skin() const;
+	sSkinDQ const* get_skin_dq() const;
+	int get_skin_num() const { return mSkinNum; }
+
+	// Conservative world bounds of the skinned mesh from per skin joint bind pose bounds.
+	// Skinned vertices are convex combinations of their joint transforms, so they
+	// stay inside the union of the transformed joint boxes.
+	sAABB calc_skinned_aabb(sAABB const* pBindBounds, uint32_t boundsNum) const;
 
 	cJoint* get_joint(int idx) const;
 	cJoint* find_joint(cstr name) const;
 
+private:
+	void alloc_skin_dq();
+
+	friend class cRigPool;
 };
 
+inline sXform& cJoint::edit_xform() {
+	mpRig->mark_local_dirty(mIdx);
+	return *mpXform;
+}
@@ -5,8 +5,18 @@
 #include "gfx.hpp"
 #include "rdr.hpp"
 #include "texture.hpp"
+#include "model_src.hpp"
+#include "meshlet.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "tri_bvh.hpp"
+#include "tri_sort.hpp"
 #include "model.hpp"
+#include "static_batch.hpp"
+#include "vtx_fmt.hpp"
+#include "instancing.hpp"
 #include "rig.hpp"
+#include "skin.hpp"
 #include "anim.hpp"
 #include "update_queue.hpp"
 #include "camera.hpp"
@@ -129,6 +139,17 @@ public:
 	virtual void disp_job(cRdrContext const& ctx) const override {
 		mModel.disp(ctx);
 	}
+
+	// Hands the model over to a static batch, which draws it from then on
+	bool add_to_batch(cStaticBatch& batch) {
+		if (!batch.add(mMdlData, mMtl, mModel.mWmtx)) { return false; }
+		mDispUpdate.reset();
+		return true;
+	}
+
+	void release_src() {
+		mMdlData.mpSrc.reset();
+	}
 };
 
 
@@ -140,6 +161,8 @@ public:
 
 		const fs::path root = cPathManager::build_data_path("lightning");
 
+		// Static, merged into cStaticGeometry unless a group is depth sorted, which also needs the source
+		mMdlData.mKeepSrc = true;
 		res = res && mMdlData.load(root / "lightning.geo");
 		res = res && mMtl.load(get_gfx().get_dev(), mMdlData, root / "lightning.mtl");
 		res = res && mModel.init(mMdlData, mMtl);
@@ -156,6 +179,87 @@ public:
 
 
 
+// Draws static models merged by material
+class cStaticGeometry : public iRdrJob {
+	cStaticBatch mBatch;
+	cUpdateSubscriberScope mDispUpdate;
+
+public:
+	bool init(std::initializer_list<cSolidModel*> models) {
+		std::vector<cSolidModel*> added;
+		for (auto pModel : models) {
+			if (pModel->add_to_batch(mBatch)) {
+				added.push_back(pModel);
+			}
+		}
+		const bool res = mBatch.build();
+		for (auto pModel : added) {
+			pModel->release_src();
+		}
+		if (res) {
+			cSceneMgr::get().get_update_queue().add(eUpdatePriority::SceneDisp, tUpdateFunc(std::bind(&cStaticGeometry::disp, this)), mDispUpdate);
+		}
+		return res;
+	}
+
+	void disp() {
+		mBatch.dbg_ui();
+
+		cRdrQueueMgr::get().add_model_job(*this);
+	}
+
+	virtual void disp_job(cRdrContext const& ctx) const override {
+		mBatch.disp(ctx);
+	}
+};
+
+
+
+// Grid of tinted copies of one model, drawn with one instanced draw per group
+class cInstancedField : public iRdrJob {
+	cModelData mMdlData;
+	cModelMaterial mMtl;
+	cInstancedModel mModel;
+	cUpdateSubscriberScope mDispUpdate;
+
+public:
+	bool init() {
+		bool res = true;
+		const fs::path root = cPathManager::build_data_path("lightning");
+
+		res = res && mMdlData.load(root / "lightning.geo");
+		res = res && mMtl.load(get_gfx().get_dev(), mMdlData, root / "lightning.mtl");
+		res = res && mModel.init(mMdlData, mMtl);
+		if (!res) { return false; }
+
+		const int side = 8;
+		const float step = 1.5f;
+		for (int z = 0; z < side; ++z) {
+			for (int x = 0; x < side; ++x) {
+				sInstance inst;
+				inst.mWmtx = dx::XMMatrixTranslation((x - side / 2) * step, 0.0f, -4.0f - z * step);
+				inst.mTint = { { 0.5f + 0.5f * x / side, 0.5f + 0.5f * z / side, 1.0f, 1.0f } };
+				mModel.mInstances.push_back(inst);
+			}
+		}
+
+		cSceneMgr::get().get_update_queue().add(eUpdatePriority::SceneDisp, tUpdateFunc(std::bind(&cInstancedField::disp, this)), mDispUpdate);
+		return true;
+	}
+
+	void disp() {
+		mModel.dbg_ui();
+
+		cRdrQueueMgr::get().add_model_job(*this);
+	}
+
+	virtual void disp_job(cRdrContext const& ctx) const override {
+		mModel.disp(ctx);
+	}
+};
+
+
+
 class cSkinnedModel : public iRdrJob {
 protected:
 	cModel mModel;
@@ -169,6 +273,13 @@ protected:
 
 	cstr mId;
 
+	bool mCpuSkin = false;
+	std::unique_ptr<sSkinnedVtx[]> mpCpuSkinVtx;
+	nSkin::sCpuStats mCpuSkinStats;
+
+	sAABB mWorldBounds;
+	bool mWorldBoundsValid = false;
+
 private:
 	cUpdateSubscriberScope mDispUpdate;
 	
@@ -181,6 +292,14 @@ public:
 	void disp() {
 		mRig.calc_local();
 		mRig.calc_world();
+		mRig.calc_skin();
+
+		if (mMdlData.mpSkinBounds && (mRig.is_world_changed() || !mWorldBoundsValid)) {
+			mWorldBounds = mRig.calc_skinned_aabb(mMdlData.mpSkinBounds.get(), mMdlData.mSkinBoundsNum);
+			mWorldBoundsValid = true;
+		}
+
+		cpu_skin();
 
 		mModel.dbg_ui();
 
@@ -189,7 +308,39 @@ public:
 
 	virtual void disp_job(cRdrContext const& ctx) const override {
 		mRig.upload_skin(ctx);
-		mModel.disp(ctx);
+		mModel.disp(ctx, &mRig);
+	}
+
+	// Shows skinned bounds, skins the model on CPU every frame when enabled and reports kernel throughput
+	void cpu_skin() {
+		if (!mMdlData.mpSkinVtx) { return; }
+
+		char buf[64];
+		::sprintf_s(buf, "skin %s", mId.p);
+		ImGui::Begin(buf);
+		if (mWorldBoundsValid) {
+			dx::XMFLOAT3 bmin, bmax;
+			dx::XMStoreFloat3(&bmin, mWorldBounds.mMin);
+			dx::XMStoreFloat3(&bmax, mWorldBounds.mMax);
+			ImGui::LabelText("bounds min", "%.2f %.2f %.2f", bmin.x, bmin.y, bmin.z);
+			ImGui::LabelText("bounds max", "%.2f %.2f %.2f", bmax.x, bmax.y, bmax.z);
+		}
+		ImGui::Checkbox("cpu skin", &mCpuSkin);
+		if (mCpuSkin) {
+			if (!(mRig.get_skin_palettes() & E_SKIN_PALETTE_MTX)) {
+				// Palette is filled by calc_skin() starting from the next frame
+				mRig.set_skin_palettes(mRig.get_skin_palettes() | E_SKIN_PALETTE_MTX);
+			}
+			if (!mpCpuSkinVtx) {
+				mpCpuSkinVtx = std::make_unique<sSkinnedVtx[]>(mMdlData.mVtxNum);
+			}
+			nSkin::skin_cpu(mRig.get_skin(), mMdlData.mpSkinVtx.get(), mpCpuSkinVtx.get(), mMdlData.mVtxNum, &mCpuSkinStats);
+
+			ImGui::LabelText("kernel", "%s", mCpuSkinStats.mAVX2 ? "AVX2" : "SSE");
+			ImGui::LabelText("vertices", "%u", mCpuSkinStats.mVtxNum);
+			ImGui::LabelText("Mvtx/s/core", "%.2f", mCpuSkinStats.vtx_per_sec_per_core() * 1e-6);
+		}
+		ImGui::End();
 	}
 };
 
@@ -202,6 +353,9 @@ protected:
 	float mSpeed = 1.0f;
 	int mCurAnim = 0;
 
+	float mEvalFrame = -1.0f;
+	int mEvalAnim = -1;
+
 private:
 	cUpdateSubscriberScope mAnimUpdate;
 
@@ -217,7 +371,12 @@ public:
 			auto& anim = mAnimList[mCurAnim];
 			float lastFrame = anim.get_last_frame();
 
-			anim.eval(mRig, mFrame);
+			// Paused animation doesn't touch the rig, so it is skipped by calc_local/calc_world
+			if (mFrame != mEvalFrame || mCurAnim != mEvalAnim) {
+				anim.eval(mRig, mFrame);
+				mEvalFrame = mFrame;
+				mEvalAnim = mCurAnim;
+			}
 			mFrame += mSpeed;
 			if (mFrame > lastFrame)
 				mFrame = 0.0f;
@@ -249,6 +408,7 @@ public:
 
 		mRigData.load(root / "def.rig");
 		mRig.init(&mRigData);
+		mRig.set_skin_palettes(mMtl.get_skin_palettes());
 
 		mAnimDataList.load(root, "def.alist");
 		mAnimList.init(mAnimDataList, mRigData);
@@ -285,6 +445,7 @@ public:
 
 		mRigData.load(root / "def.rig");
 		mRig.init(&mRigData);
+		mRig.set_skin_palettes(mMtl.get_skin_palettes());
 
 		mAnimDataList.load(root, "def.alist");
 		mAnimList.init(mAnimDataList, mRigData);
@@ -325,6 +486,7 @@ public:
 
 			mRigData.load(loader);
 			mRig.init(&mRigData);
+			mRig.set_skin_palettes(mMtl.get_skin_palettes());
 		}
 		{
 			cAssimpLoader animLoader;
@@ -422,6 +584,8 @@ public:
 	}
 
 	void update_begin() {
+		// Before any job is queued, defragmentation replaces the heap buffers
+		cGeoHeap::get().dbg_ui();
 		cRdrQueueMgr::get().add_model_prologue_job(*this);
 	}
 	
@@ -628,6 +792,8 @@ public:
 class cScene {
 	cGnomon gnomon;
 	cLightning lightning;
+	cStaticGeometry staticGeo;
+	cInstancedField instancedField;
 	cJumpingSphere sphere;
 	cOwl owl;
 	cUnrealPuppet upuppet;
@@ -640,6 +806,8 @@ public:
 	cScene() {
 		gnomon.init();
 		lightning.init();
+		staticGeo.init({ &lightning });
+		instancedField.init();
 		sphere.init();
 		owl.init();
 		upuppet.init();
@@ -5,6 +5,12 @@
 #include "rdr.hpp"
 #include "path_helpers.hpp"
 #include "texture.hpp"
+#include "model_src.hpp"
+#include "meshlet.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "tri_bvh.hpp"
+#include "tri_sort.hpp"
 #include "model.hpp"
 #include "camera.hpp"
 #include "sh.hpp"
@@ -105,6 +111,8 @@ void sGroupMaterial::serialize(Archive& arc) {
 	ARC(CEREAL_NVP(vsProg));
 	ARC(CEREAL_NVP(psProg));
 	ARCD(CEREAL_NVP(twosided), false);
+	ARCD(CEREAL_NVP(dqSkin), false);
+	ARCD(CEREAL_NVP(depthSort), false);
 	ARC(CEREAL_NVP(params));
 }
 
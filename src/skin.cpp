@@ -0,0 +1,186 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "skin.hpp"
+#include "parallel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <intrin.h>
+
+namespace dx = DirectX;
+
+namespace nSkin {
+
+static void mtx_to_dq4(sSkinMtx const* pMtx, sSkinDQ* pDQ) {
+	// sSkinMtx keeps columns of the row-vector matrix M, so after transposition
+	// mIJ holds element M[I][J] of 4 matrices, and tX holds translation.
+	const dx::XMMATRIX c0 = dx::XMMatrixTranspose(dx::XMMATRIX(pMtx[0].r[0], pMtx[1].r[0], pMtx[2].r[0], pMtx[3].r[0]));
+	const dx::XMMATRIX c1 = dx::XMMatrixTranspose(dx::XMMATRIX(pMtx[0].r[1], pMtx[1].r[1], pMtx[2].r[1], pMtx[3].r[1]));
+	const dx::XMMATRIX c2 = dx::XMMatrixTranspose(dx::XMMATRIX(pMtx[0].r[2], pMtx[1].r[2], pMtx[2].r[2], pMtx[3].r[2]));
+
+	dx::XMVECTOR m00 = c0.r[0], m10 = c0.r[1], m20 = c0.r[2];
+	dx::XMVECTOR m01 = c1.r[0], m11 = c1.r[1], m21 = c1.r[2];
+	dx::XMVECTOR m02 = c2.r[0], m12 = c2.r[1], m22 = c2.r[2];
+	const dx::XMVECTOR tx = c0.r[3], ty = c1.r[3], tz = c2.r[3];
+
+	// Remove scale from basis rows
+	auto normalize_row = [](dx::XMVECTOR& a, dx::XMVECTOR& b, dx::XMVECTOR& c) {
+		dx::XMVECTOR sq = dx::XMVectorMultiply(a, a);
+		sq = dx::XMVectorMultiplyAdd(b, b, sq);
+		sq = dx::XMVectorMultiplyAdd(c, c, sq);
+		const dx::XMVECTOR inv = dx::XMVectorReciprocalSqrt(sq);
+		a = dx::XMVectorMultiply(a, inv);
+		b = dx::XMVectorMultiply(b, inv);
+		c = dx::XMVectorMultiply(c, inv);
+	};
+	normalize_row(m00, m01, m02);
+	normalize_row(m10, m11, m12);
+	normalize_row(m20, m21, m22);
+
+	// Branchless rotation matrix to quaternion, signs are taken from
+	// the antisymmetric part of the row-vector matrix.
+	const dx::XMVECTOR zero = dx::XMVectorZero();
+	const dx::XMVECTOR half = dx::XMVectorReplicate(0.5f);
+	auto component = [&](dx::XMVECTOR diag, dx::XMVECTOR signSrc) {
+		dx::XMVECTOR v = dx::XMVectorAdd(dx::g_XMOne, diag);
+		v = dx::XMVectorMultiply(half, dx::XMVectorSqrt(dx::XMVectorMax(v, zero)));
+		return dx::XMVectorSelect(v, dx::XMVectorNegate(v), dx::XMVectorLess(signSrc, zero));
+	};
+	dx::XMVECTOR qw = dx::XMVectorMultiply(half, dx::XMVectorSqrt(dx::XMVectorMax(
+		dx::XMVectorAdd(dx::g_XMOne, dx::XMVectorAdd(m00, dx::XMVectorAdd(m11, m22))), zero)));
+	dx::XMVECTOR qx = component(dx::XMVectorSubtract(m00, dx::XMVectorAdd(m11, m22)), dx::XMVectorSubtract(m12, m21));
+	dx::XMVECTOR qy = component(dx::XMVectorSubtract(m11, dx::XMVectorAdd(m00, m22)), dx::XMVectorSubtract(m20, m02));
+	dx::XMVECTOR qz = component(dx::XMVectorSubtract(m22, dx::XMVectorAdd(m00, m11)), dx::XMVectorSubtract(m01, m10));
+
+	dx::XMVECTOR sq = dx::XMVectorMultiply(qx, qx);
+	sq = dx::XMVectorMultiplyAdd(qy, qy, sq);
+	sq = dx::XMVectorMultiplyAdd(qz, qz, sq);
+	sq = dx::XMVectorMultiplyAdd(qw, qw, sq);
+	const dx::XMVECTOR inv = dx::XMVectorReciprocalSqrt(sq);
+	qx = dx::XMVectorMultiply(qx, inv);
+	qy = dx::XMVectorMultiply(qy, inv);
+	qz = dx::XMVectorMultiply(qz, inv);
+	qw = dx::XMVectorMultiply(qw, inv);
+
+	// dual = 0.5 * (t, 0) * real
+	dx::XMVECTOR dualX = dx::XMVectorMultiply(tx, qw);
+	dualX = dx::XMVectorMultiplyAdd(ty, qz, dualX);
+	dualX = dx::XMVectorNegativeMultiplySubtract(tz, qy, dualX);
+	dx::XMVECTOR dualY = dx::XMVectorMultiply(ty, qw);
+	dualY = dx::XMVectorMultiplyAdd(tz, qx, dualY);
+	dualY = dx::XMVectorNegativeMultiplySubtract(tx, qz, dualY);
+	dx::XMVECTOR dualZ = dx::XMVectorMultiply(tz, qw);
+	dualZ = dx::XMVectorMultiplyAdd(tx, qy, dualZ);
+	dualZ = dx::XMVectorNegativeMultiplySubtract(ty, qx, dualZ);
+	dx::XMVECTOR dualW = dx::XMVectorMultiply(tx, qx);
+	dualW = dx::XMVectorMultiplyAdd(ty, qy, dualW);
+	dualW = dx::XMVectorMultiplyAdd(tz, qz, dualW);
+	dualW = dx::XMVectorNegate(dualW);
+
+	const dx::XMMATRIX real = dx::XMMatrixTranspose(dx::XMMATRIX(qx, qy, qz, qw));
+	const dx::XMMATRIX dual = dx::XMMatrixTranspose(dx::XMMATRIX(
+		dx::XMVectorMultiply(dualX, half), dx::XMVectorMultiply(dualY, half),
+		dx::XMVectorMultiply(dualZ, half), dx::XMVectorMultiply(dualW, half)));
+
+	for (int i = 0; i < 4; ++i) {
+		pDQ[i].real = real.r[i];
+		pDQ[i].dual = dual.r[i];
+	}
+}
+
+void mtx_to_dq(sSkinMtx const* pMtx, sSkinDQ* pDQ, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		mtx_to_dq4(&pMtx[i], &pDQ[i]);
+	}
+
+	if (i < count) {
+		sSkinMtx mtx[4];
+		sSkinDQ dq[4];
+		for (int j = 0; j < 4; ++j) {
+			mtx[j] = pMtx[std::min(i + j, count - 1)];
+		}
+		mtx_to_dq4(mtx, dq);
+		for (int j = 0; i + j < count; ++j) {
+			pDQ[i + j] = dq[j];
+		}
+	}
+}
+
+static dx::XMMATRIX blend_palette(sSkinMtx const* pPalette, sSkinVtx const& vtx) {
+	dx::XMVECTOR r0 = dx::XMVectorZero();
+	dx::XMVECTOR r1 = dx::XMVectorZero();
+	dx::XMVECTOR r2 = dx::XMVectorZero();
+	for (int i = 0; i < 4; ++i) {
+		const float w = vtx.jwgt[i];
+		if (w == 0.0f) { continue; }
+		auto const& skin = pPalette[vtx.jidx[i]];
+		const dx::XMVECTOR vw = dx::XMVectorReplicate(w);
+		r0 = dx::XMVectorMultiplyAdd(skin.r[0], vw, r0);
+		r1 = dx::XMVectorMultiplyAdd(skin.r[1], vw, r1);
+		r2 = dx::XMVectorMultiplyAdd(skin.r[2], vw, r2);
+	}
+	// Back to the row-vector form used by XMVector3Transform
+	return dx::XMMatrixTranspose(dx::XMMATRIX(r0, r1, r2, dx::g_XMIdentityR3));
+}
+
+void skin_cpu_sse(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum) {
+	for (uint32_t i = 0; i < vtxNum; ++i) {
+		auto const& vtx = pIn[i];
+		auto& out = pOut[i];
+		const dx::XMMATRIX m = blend_palette(pPalette, vtx);
+
+		const dx::XMVECTOR pos = dx::XMVector3Transform(dx::XMLoadFloat3((dx::XMFLOAT3 const*)vtx.pos), m);
+		const dx::XMVECTOR nrm = dx::XMVector3TransformNormal(dx::XMLoadFloat3((dx::XMFLOAT3 const*)vtx.nrm), m);
+		const dx::XMVECTOR tgt = dx::XMVector3TransformNormal(dx::XMLoadFloat3((dx::XMFLOAT3 const*)vtx.tgt), m);
+
+		dx::XMStoreFloat3((dx::XMFLOAT3*)out.pos, pos);
+		dx::XMStoreFloat3((dx::XMFLOAT3*)out.nrm, dx::XMVector3Normalize(nrm));
+		dx::XMStoreFloat3((dx::XMFLOAT3*)out.tgt, dx::XMVector3Normalize(tgt));
+		out.tgt[3] = vtx.tgt[3];
+	}
+}
+
+bool cpu_has_avx2() {
+	static const bool hasAVX2 = []() {
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) { return false; }
+
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool fma = (info[2] & (1 << 12)) != 0;
+		if (!osxsave || !avx || !fma) { return false; }
+		// OS has to preserve ymm registers
+		if ((_xgetbv(0) & 6) != 6) { return false; }
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	}();
+	return hasAVX2;
+}
+
+void skin_cpu(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum, sCpuStats* pStats/* = nullptr*/) {
+	const bool useAVX2 = cpu_has_avx2();
+	auto kernel = useAVX2 ? skin_cpu_avx2 : skin_cpu_sse;
+
+	// Large enough to hide the scheduling cost, small enough to balance cores
+	const uint32_t grain = 4096;
+	std::atomic<int64_t> kernelNs{0};
+	nParallel::for_ranges(vtxNum, grain, [&](uint32_t begin, uint32_t end) {
+		const auto start = std::chrono::steady_clock::now();
+		kernel(pPalette, pIn + begin, pOut + begin, end - begin);
+		const auto spent = std::chrono::steady_clock::now() - start;
+		kernelNs += std::chrono::duration_cast<std::chrono::nanoseconds>(spent).count();
+	});
+
+	if (pStats) {
+		pStats->mVtxNum = vtxNum;
+		pStats->mCoreSeconds = kernelNs * 1e-9;
+		pStats->mAVX2 = useAVX2;
+	}
+}
+
+} // namespace nSkin
@@ -0,0 +1,51 @@
+
+struct sSkinMtx;
+struct sSkinDQ;
+
+// CPU skinning input. jidx are skin palette indices, unused slots have zero
+// weight and index.
+struct sSkinVtx {
+	float pos[3];
+	float nrm[3];
+	float tgt[4];
+	int32_t jidx[4];
+	float jwgt[4];
+};
+
+// CPU skinning output, tightly packed to be copied into a dynamic vertex stream
+struct sSkinnedVtx {
+	float pos[3];
+	float nrm[3];
+	float tgt[4];
+};
+
+namespace nSkin {
+
+struct sCpuStats {
+	uint32_t mVtxNum = 0;
+	// Time spent in the kernels summed over all worker threads
+	double mCoreSeconds = 0.0;
+	bool mAVX2 = false;
+
+	double vtx_per_sec_per_core() const {
+		return mCoreSeconds > 0.0 ? mVtxNum / mCoreSeconds : 0.0;
+	}
+};
+
+// Converts affine skin matrices to unit dual quaternions.
+// Processes 4 joints per iteration in SoA form. Scale is removed from the
+// matrices, so dual quaternion skinning expects rigid joints.
+void mtx_to_dq(sSkinMtx const* pMtx, sSkinDQ* pDQ, int count);
+
+// Skins positions, normals and tangents with the matrix palette.
+// Output is in the palette space, world space for cRig::get_skin.
+// Runs on all cores over vertex ranges and uses the AVX2 kernel when supported.
+void skin_cpu(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum, sCpuStats* pStats = nullptr);
+
+// Single threaded kernels
+void skin_cpu_sse(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum);
+void skin_cpu_avx2(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum);
+
+bool cpu_has_avx2();
+
+} // namespace nSkin
@@ -0,0 +1,94 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "skin.hpp"
+
+#include <immintrin.h>
+
+// Compiled with /arch:AVX2, only called after nSkin::cpu_has_avx2 check
+
+namespace nSkin {
+
+// 8 vertices per iteration in SoA form. Vertex fields and palette rows are gathered,
+// sSkinVtx and sSkinMtx are arrays of floats with 18 and 12 floats stride.
+static_assert(sizeof(sSkinVtx) == 18 * sizeof(float), "sSkinVtx layout");
+static_assert(sizeof(sSkinMtx) == 12 * sizeof(float), "sSkinMtx layout");
+
+static inline __m256 gather(float const* pBase, __m256i idx, int offset) {
+	return _mm256_i32gather_ps(pBase + offset, idx, 4);
+}
+
+static inline __m256 normalize_scale(__m256 x, __m256 y, __m256 z) {
+	__m256 sq = _mm256_mul_ps(x, x);
+	sq = _mm256_fmadd_ps(y, y, sq);
+	sq = _mm256_fmadd_ps(z, z, sq);
+	return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(sq));
+}
+
+static void skin8(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut) {
+	float const* pVtxF = reinterpret_cast<float const*>(pIn);
+	float const* pPalF = reinterpret_cast<float const*>(pPalette);
+	const __m256i vtxIdx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(18));
+
+	// Blended palette rows, m[row * 4 + col]
+	__m256 m[12];
+	for (int i = 0; i < 12; ++i) {
+		m[i] = _mm256_setzero_ps();
+	}
+	for (int k = 0; k < 4; ++k) {
+		const __m256 w = gather(pVtxF, vtxIdx, offsetof(sSkinVtx, jwgt) / 4 + k);
+		const __m256i jidx = _mm256_i32gather_epi32(reinterpret_cast<int const*>(pVtxF) + offsetof(sSkinVtx, jidx) / 4 + k, vtxIdx, 4);
+		const __m256i palIdx = _mm256_mullo_epi32(jidx, _mm256_set1_epi32(12));
+		for (int i = 0; i < 12; ++i) {
+			m[i] = _mm256_fmadd_ps(gather(pPalF, palIdx, i), w, m[i]);
+		}
+	}
+
+	auto transform = [&m](__m256 x, __m256 y, __m256 z, __m256* pRes, bool point) {
+		for (int row = 0; row < 3; ++row) {
+			__m256 r = _mm256_mul_ps(m[row * 4 + 0], x);
+			r = _mm256_fmadd_ps(m[row * 4 + 1], y, r);
+			r = _mm256_fmadd_ps(m[row * 4 + 2], z, r);
+			pRes[row] = point ? _mm256_add_ps(r, m[row * 4 + 3]) : r;
+		}
+	};
+
+	__m256 pos[3];
+	__m256 nrm[3];
+	__m256 tgt[3];
+	transform(gather(pVtxF, vtxIdx, 0), gather(pVtxF, vtxIdx, 1), gather(pVtxF, vtxIdx, 2), pos, true);
+	transform(gather(pVtxF, vtxIdx, 3), gather(pVtxF, vtxIdx, 4), gather(pVtxF, vtxIdx, 5), nrm, false);
+	transform(gather(pVtxF, vtxIdx, 6), gather(pVtxF, vtxIdx, 7), gather(pVtxF, vtxIdx, 8), tgt, false);
+
+	const __m256 nrmScl = normalize_scale(nrm[0], nrm[1], nrm[2]);
+	const __m256 tgtScl = normalize_scale(tgt[0], tgt[1], tgt[2]);
+
+	// AVX2 has no scatter, transpose through the stack
+	alignas(32) float res[9][8];
+	for (int i = 0; i < 3; ++i) {
+		_mm256_store_ps(res[i], pos[i]);
+		_mm256_store_ps(res[3 + i], _mm256_mul_ps(nrm[i], nrmScl));
+		_mm256_store_ps(res[6 + i], _mm256_mul_ps(tgt[i], tgtScl));
+	}
+	for (int j = 0; j < 8; ++j) {
+		auto& out = pOut[j];
+		for (int i = 0; i < 3; ++i) {
+			out.pos[i] = res[i][j];
+			out.nrm[i] = res[3 + i][j];
+			out.tgt[i] = res[6 + i][j];
+		}
+		out.tgt[3] = pIn[j].tgt[3];
+	}
+}
+
+void skin_cpu_avx2(sSkinMtx const* pPalette, sSkinVtx const* pIn, sSkinnedVtx* pOut, uint32_t vtxNum) {
+	uint32_t i = 0;
+	for (; i + 8 <= vtxNum; i += 8) {
+		skin8(pPalette, &pIn[i], &pOut[i]);
+	}
+	if (i < vtxNum) {
+		skin_cpu_sse(pPalette, &pIn[i], &pOut[i], vtxNum - i);
+	}
+}
+
+} // namespace nSkin
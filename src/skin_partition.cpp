@@ -0,0 +1,182 @@
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "model_src.hpp"
+#include "skin_partition.hpp"
+
+#include <cassert>
+
+namespace nSkinPartition {
+
+static const uint32_t VTX_FREE = UINT32_MAX;
+static const uint32_t VTX_GLOBAL = UINT32_MAX - 1;
+
+// Joints influencing a triangle, 4 per vertex at most
+struct sTriJnt {
+	int32_t mJnt[12];
+	int32_t mNum;
+};
+
+static bool needs_partition(sModelSrc const& src, sModelSrcGroup const& grp, uint32_t maxJnt) {
+	for (uint32_t idx : grp.mIdx) {
+		auto const& vtx = src.mVtx[idx];
+		for (int i = 0; i < 4; ++i) {
+			if (vtx.jwgt[i] > 0.0f && vtx.jidx[i] >= (int32_t)maxJnt) { return true; }
+		}
+	}
+	return false;
+}
+
+sStats partition(sModelSrc& src, uint32_t maxJnt) {
+	assert(maxJnt >= 12);
+	sStats stats;
+
+	const uint32_t grpNum = (uint32_t)src.mGroups.size();
+	std::vector<bool> split(grpNum);
+	bool anySplit = false;
+	for (uint32_t i = 0; i < grpNum; ++i) {
+		split[i] = needs_partition(src, src.mGroups[i], maxJnt);
+		anySplit = anySplit || split[i];
+	}
+	if (!anySplit) { return stats; }
+
+	// Original joint indices, as vertices are remapped in place
+	const uint32_t srcVtxNum = (uint32_t)src.mVtx.size();
+	std::vector<vec4i> srcJidx(srcVtxNum);
+	int32_t jntNum = 0;
+	for (uint32_t i = 0; i < srcVtxNum; ++i) {
+		auto const& vtx = src.mVtx[i];
+		srcJidx[i] = vtx.jidx;
+		for (int j = 0; j < 4; ++j) {
+			if (vtx.jwgt[j] > 0.0f) {
+				jntNum = std::max(jntNum, vtx.jidx[j] + 1);
+			}
+		}
+	}
+
+	// Vertices of not split groups keep global joint indices
+	std::vector<uint32_t> vtxOwner(srcVtxNum, VTX_FREE);
+	for (uint32_t i = 0; i < grpNum; ++i) {
+		if (split[i]) { continue; }
+		for (uint32_t idx : src.mGroups[i].mIdx) {
+			vtxOwner[idx] = VTX_GLOBAL;
+		}
+	}
+
+	std::vector<uint32_t> jntStamp(jntNum, UINT32_MAX);
+	std::vector<int32_t> jntLocal(jntNum, 0);
+	std::vector<uint32_t> dupStamp(srcVtxNum, UINT32_MAX);
+	std::vector<uint32_t> dupIdx(srcVtxNum, 0);
+	uint32_t partId = 0;
+
+	auto localize = [&](sModelVtx& vtx, vec4i const& jidx) {
+		for (int i = 0; i < 4; ++i) {
+			vtx.jidx[i] = (vtx.jwgt[i] > 0.0f) ? jntLocal[jidx[i]] : 0;
+		}
+	};
+
+	auto remap_vtx = [&](uint32_t v) -> uint32_t {
+		const uint32_t owner = vtxOwner[v];
+		if (owner == partId) { return v; }
+		if (owner == VTX_FREE) {
+			vtxOwner[v] = partId;
+			localize(src.mVtx[v], srcJidx[v]);
+			return v;
+		}
+		if (dupStamp[v] == partId) { return dupIdx[v]; }
+
+		sModelVtx dup = src.mVtx[v];
+		localize(dup, srcJidx[v]);
+		const uint32_t dupV = (uint32_t)src.mVtx.size();
+		src.mVtx.push_back(dup);
+		dupStamp[v] = partId;
+		dupIdx[v] = dupV;
+		stats.mDupVtx++;
+		return dupV;
+	};
+
+	std::vector<sTriJnt> triJnt;
+	std::vector<uint32_t> remaining;
+	std::vector<uint32_t> next;
+	std::vector<uint32_t> newIdx;
+
+	for (uint32_t igrp = 0; igrp < grpNum; ++igrp) {
+		if (!split[igrp]) { continue; }
+		auto& grp = src.mGroups[igrp];
+
+		const uint32_t triNum = (uint32_t)grp.mIdx.size() / 3;
+		triJnt.resize(triNum);
+		for (uint32_t t = 0; t < triNum; ++t) {
+			auto& tj = triJnt[t];
+			tj.mNum = 0;
+			for (int c = 0; c < 3; ++c) {
+				const uint32_t v = grp.mIdx[t * 3 + c];
+				auto const& vtx = src.mVtx[v];
+				for (int i = 0; i < 4; ++i) {
+					const int32_t j = srcJidx[v][i];
+					if (!(vtx.jwgt[i] > 0.0f) || j < 0) { continue; }
+					if (std::find(tj.mJnt, tj.mJnt + tj.mNum, j) == tj.mJnt + tj.mNum) {
+						tj.mJnt[tj.mNum++] = j;
+					}
+				}
+			}
+		}
+
+		remaining.resize(triNum);
+		std::iota(remaining.begin(), remaining.end(), 0);
+		newIdx.clear();
+		newIdx.reserve(grp.mIdx.size());
+		grp.mSkinParts.clear();
+		grp.mSkinJnt.clear();
+
+		// First fit: every pass over the remaining triangles fills one part
+		while (!remaining.empty()) {
+			sSkinPart part;
+			part.mIdxStart = (uint32_t)newIdx.size();
+			part.mJntOffset = (uint32_t)grp.mSkinJnt.size();
+			part.mJntNum = 0;
+			next.clear();
+
+			for (uint32_t t : remaining) {
+				auto const& tj = triJnt[t];
+				uint32_t added = 0;
+				for (int i = 0; i < tj.mNum; ++i) {
+					added += (jntStamp[tj.mJnt[i]] != partId) ? 1 : 0;
+				}
+				if (part.mJntNum + added > maxJnt) {
+					next.push_back(t);
+					continue;
+				}
+
+				for (int i = 0; i < tj.mNum; ++i) {
+					const int32_t j = tj.mJnt[i];
+					if (jntStamp[j] != partId) {
+						jntStamp[j] = partId;
+						jntLocal[j] = part.mJntNum++;
+						grp.mSkinJnt.push_back((uint16_t)j);
+					}
+				}
+				for (int c = 0; c < 3; ++c) {
+					newIdx.push_back(remap_vtx(grp.mIdx[t * 3 + c]));
+				}
+			}
+
+			part.mIdxCount = (uint32_t)newIdx.size() - part.mIdxStart;
+			grp.mSkinParts.push_back(part);
+			++partId;
+			remaining.swap(next);
+		}
+
+		grp.mIdx.swap(newIdx);
+		stats.mGroups++;
+		stats.mParts += (uint32_t)grp.mSkinParts.size();
+	}
+
+	return stats;
+}
+
+} // namespace nSkinPartition
@@ -0,0 +1,16 @@
+
+struct sModelSrc;
+
+namespace nSkinPartition {
+
+struct sStats {
+	uint32_t mGroups = 0;
+	uint32_t mParts = 0;
+	uint32_t mDupVtx = 0;
+};
+
+// Splits skinned groups which reference joints beyond maxJnt into sub-draws
+// of at most maxJnt joints. Vertices shared between parts are duplicated.
+sStats partition(sModelSrc& src, uint32_t maxJnt);
+
+} // namespace nSkinPartition
@@ -0,0 +1,276 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "gfx.hpp"
+#include "model_src.hpp"
+#include "meshlet.hpp"
+#include "range_alloc.hpp"
+#include "geo_heap.hpp"
+#include "tri_bvh.hpp"
+#include "tri_sort.hpp"
+#include "vtx_fmt.hpp"
+#include "model.hpp"
+#include "static_batch.hpp"
+#include "imgui.hpp"
+
+#include <algorithm>
+
+namespace dx = DirectX;
+
+// Groups merge when everything bound by cModelMaterial::apply is the same
+static bool is_same_mtl(cModelMaterial const& a, uint32_t aGrp, cModelMaterial const& b, uint32_t bGrp) {
+	sGroupMaterial const& am = a.mpGrpMtl[aGrp];
+	sGroupMaterial const& bm = b.mpGrpMtl[bGrp];
+	sGroupMtlRes const& ar = a.mpGrpRes[aGrp];
+	sGroupMtlRes const& br = b.mpGrpRes[bGrp];
+	return ::memcmp(&am.params, &bm.params, sizeof(am.params)) == 0
+		&& am.vsProg == bm.vsProg
+		&& am.dqSkin == bm.dqSkin
+		&& ar.mpTexBase == br.mpTexBase && ar.mpSmpBase == br.mpSmpBase
+		&& ar.mpTexNmap0 == br.mpTexNmap0 && ar.mpSmpNmap0 == br.mpSmpNmap0
+		&& ar.mpTexNmap1 == br.mpTexNmap1 && ar.mpSmpNmap1 == br.mpSmpNmap1
+		&& ar.mpTexMask == br.mpTexMask && ar.mpSmpMask == br.mpSmpMask
+		&& ar.mpPS == br.mpPS
+		&& ar.mpRSState == br.mpRSState;
+}
+
+// Mirroring transforms flip the winding, which is restored by swapping two corners
+static const uint32_t s_mirrorCorner[3] = { 0, 2, 1 };
+
+static vec3 store_vec3(dx::FXMVECTOR v) {
+	vec3 res;
+	dx::XMStoreFloat3((dx::XMFLOAT3*)&res, v);
+	return res;
+}
+
+static dx::XMVECTOR safe_normalize(dx::FXMVECTOR v) {
+	return dx::XMVectorGetX(dx::XMVector3LengthSq(v)) > 1e-12f ? dx::XMVector3Normalize(v) : v;
+}
+
+bool cStaticBatch::add(cModelData const& data, cModelMaterial const& mtl, dx::FXMMATRIX wmtx) {
+	if (!data.mpSrc || data.mpSkinVtx) { return false; }
+	// Merged ranges keep their import order, sorted groups need a new one every frame
+	for (uint32_t i = 0; i < data.mGrpNum; ++i) {
+		if (mtl.mpGrpMtl[i].depthSort) { return false; }
+	}
+	mObjects.push_back({ &data, &mtl, wmtx });
+	return true;
+}
+
+bool cStaticBatch::build() {
+	deinit();
+	mStats = {};
+
+	// Source groups in material order, keeping the add order within a material
+	struct sItem {
+		uint32_t mObj;
+		uint32_t mGrp;
+	};
+	std::vector<std::vector<sItem>> mtlItems;
+	for (uint32_t i = 0; i < (uint32_t)mObjects.size(); ++i) {
+		auto const& obj = mObjects[i];
+		for (uint32_t j = 0; j < obj.mpData->mGrpNum; ++j) {
+			if (obj.mpData->mpSrc->mGroups[j].mIdx.empty()) { continue; }
+			mStats.mDrawsBefore++;
+			auto itMtl = std::find_if(mtlItems.begin(), mtlItems.end(), [&](std::vector<sItem> const& items) {
+				auto const& first = mObjects[items[0].mObj];
+				return is_same_mtl(*first.mpMtl, items[0].mGrp, *obj.mpMtl, j);
+			});
+			if (itMtl == mtlItems.end()) {
+				mtlItems.emplace_back();
+				itMtl = mtlItems.end() - 1;
+			}
+			itMtl->push_back({ i, j });
+		}
+	}
+	if (mtlItems.empty()) { return false; }
+
+	std::vector<sModelVtx> vtx;
+	std::vector<uint32_t> idx;
+	std::vector<uint32_t> remap;
+	uint32_t rangesMax = 0;
+	for (auto const& items : mtlItems) {
+		sBatch batch = {};
+		batch.mpMtl = mObjects[items[0].mObj].mpMtl;
+		batch.mMtlGrp = items[0].mGrp;
+		batch.mBaseVtx = (uint32_t)vtx.size();
+		batch.mIdxOffset = (uint32_t)idx.size();
+		batch.mRangeOffset = (uint32_t)mRanges.size();
+
+		for (auto const& item : items) {
+			auto const& obj = mObjects[item.mObj];
+			sModelSrc const& src = *obj.mpData->mpSrc;
+			sModelSrcGroup const& grp = src.mGroups[item.mGrp];
+
+			const dx::XMMATRIX nrmMtx = dx::XMMatrixTranspose(dx::XMMatrixInverse(nullptr, obj.mWmtx));
+			const bool mirrored = dx::XMVectorGetX(dx::XMMatrixDeterminant(obj.mWmtx)) < 0.0f;
+
+			// Only vertices referenced by the group are copied, in first use order
+			remap.assign(src.mVtx.size(), UINT32_MAX);
+			sMeshlet range = {};
+			range.mIdxStart = (uint32_t)idx.size() - batch.mIdxOffset;
+			range.mIdxCount = (uint32_t)grp.mIdx.size();
+			for (uint32_t i = 0; i < (uint32_t)grp.mIdx.size(); ++i) {
+				const uint32_t srcIdx = grp.mIdx[mirrored ? i - i % 3 + s_mirrorCorner[i % 3] : i];
+				if (remap[srcIdx] == UINT32_MAX) {
+					remap[srcIdx] = (uint32_t)vtx.size();
+					sModelVtx v = src.mVtx[srcIdx];
+					const float handedness = mirrored ? -v.tgt.w : v.tgt.w;
+					v.pos = store_vec3(dx::XMVector3TransformCoord(dx::XMLoadFloat3((dx::XMFLOAT3 const*)&v.pos), obj.mWmtx));
+					v.nrm = store_vec3(safe_normalize(dx::XMVector3TransformNormal(dx::XMLoadFloat3((dx::XMFLOAT3 const*)&v.nrm), nrmMtx)));
+					v.bitgt = store_vec3(safe_normalize(dx::XMVector3TransformNormal(dx::XMLoadFloat3((dx::XMFLOAT3 const*)&v.bitgt), obj.mWmtx)));
+					const vec3 tgt = store_vec3(safe_normalize(dx::XMVector3TransformNormal(dx::XMLoadFloat3((dx::XMFLOAT3 const*)&v.tgt), obj.mWmtx)));
+					v.tgt = { { tgt.x, tgt.y, tgt.z, handedness } };
+					vtx.push_back(v);
+				}
+				idx.push_back(remap[srcIdx]);
+			}
+
+			const sSphere sphere = obj.mpData->mpGrpSpheres[item.mGrp].transform(obj.mWmtx);
+			range.mCenter = store_vec3(sphere.get_center());
+			range.mRadius = sphere.get_radius();
+			range.mConeCutoff = 2.0f;
+			mRanges.push_back(range);
+			mStats.mTrisTotal += range.mIdxCount / 3;
+		}
+
+		batch.mIdxCount = (uint32_t)idx.size() - batch.mIdxOffset;
+		batch.mRangeNum = (uint32_t)mRanges.size() - batch.mRangeOffset;
+		rangesMax = std::max(rangesMax, batch.mRangeNum);
+		mBatches.push_back(batch);
+	}
+
+	// Same layout as cModelData, batches spanning more than 64K vertices use 32 bit indices
+	std::vector<uint32_t> srcOffsets(mBatches.size());
+	uint32_t idxUnits = 0;
+	for (size_t i = 0; i < mBatches.size(); ++i) {
+		auto& batch = mBatches[i];
+		const uint32_t vtxEnd = i + 1 < mBatches.size() ? mBatches[i + 1].mBaseVtx : (uint32_t)vtx.size();
+		const bool is32 = vtxEnd - batch.mBaseVtx > 0x10000;
+		if (is32) {
+			idxUnits = (idxUnits + 1) & ~1u;
+		}
+		srcOffsets[i] = batch.mIdxOffset;
+		batch.mIdxFormat = is32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+		batch.mIdxOffset = idxUnits * sizeof(uint16_t);
+		idxUnits += batch.mIdxCount * (is32 ? 2 : 1);
+	}
+
+	auto pIdx = std::make_unique<uint16_t[]>(std::max(idxUnits, 1u));
+	for (size_t i = 0; i < mBatches.size(); ++i) {
+		auto const& batch = mBatches[i];
+		uint16_t* pIdxBatch = &pIdx[batch.mIdxOffset / sizeof(uint16_t)];
+		uint32_t const* pSrc = &idx[srcOffsets[i]];
+		if (batch.mIdxFormat == DXGI_FORMAT_R32_UINT) {
+			uint32_t* pIdx32 = reinterpret_cast<uint32_t*>(pIdxBatch);
+			for (uint32_t j = 0; j < batch.mIdxCount; ++j) {
+				pIdx32[j] = pSrc[j] - batch.mBaseVtx;
+			}
+		} else {
+			for (uint32_t j = 0; j < batch.mIdxCount; ++j) {
+				pIdxBatch[j] = (uint16_t)(pSrc[j] - batch.mBaseVtx);
+			}
+		}
+	}
+
+	const uint32_t numVtx = (uint32_t)vtx.size();
+	const eVtxFmt vtxFmt = nVtxFmt::choose(vtx.data(), numVtx);
+	const uint32_t vtxSize = nVtxFmt::get_size(vtxFmt);
+	auto pVtx = std::make_unique<uint8_t[]>(size_t(numVtx) * vtxSize);
+	nVtxFmt::encode(vtxFmt, vtx.data(), numVtx, pVtx.get());
+
+	auto& ss = cShaderStorage::get();
+	auto pLayoutVS = ss.load_VS(nVtxFmt::get_layout_vs(vtxFmt));
+	if (!pLayoutVS) { return false; }
+	for (auto& batch : mBatches) {
+		sGroupMaterial const& mtl = batch.mpMtl->mpGrpMtl[batch.mMtlGrp];
+		const std::string vsProg = nVtxFmt::get_vs_variant(mtl.vsProg, vtxFmt);
+		batch.mpVS = ss.load_VS(vsProg.c_str());
+		if (!batch.mpVS) { return false; }
+	}
+
+	uint32_t vdscNum = 0;
+	auto vdsc = nVtxFmt::get_input_desc(vtxFmt, vdscNum);
+	auto pDev = get_gfx().get_dev();
+	auto& code = pLayoutVS->get_code();
+	HRESULT hr = pDev->CreateInputLayout(vdsc, vdscNum, code.get_code(), code.get_size(), mpIL.pp());
+	if (!SUCCEEDED(hr)) throw sD3DException(hr, "CreateInputLayout failed");
+
+	mVtx.init(pDev, pVtx.get(), numVtx, vtxSize);
+	mIdx.init(pDev, pIdx.get(), std::max(idxUnits, 1u), DXGI_FORMAT_R16_UINT);
+	mVtxFmt = vtxFmt;
+	mpCullRanges = std::make_unique<nMeshlet::sRange[]>(rangesMax);
+
+	mStats.mObjects = (uint32_t)mObjects.size();
+	mStats.mBatches = (uint32_t)mBatches.size();
+	dbg_msg("static batch: %u objects, %u draws -> %u batches, %u vertices (%s), %u triangles\n",
+		mStats.mObjects, mStats.mDrawsBefore, mStats.mBatches, numVtx, nVtxFmt::get_name(vtxFmt), mStats.mTrisTotal);
+
+	return true;
+}
+
+void cStaticBatch::deinit() {
+	mBatches.clear();
+	mRanges.clear();
+	mpCullRanges.reset();
+	mVtx.deinit();
+	mIdx.deinit();
+	mpIL.reset();
+}
+
+void cStaticBatch::disp(cRdrContext const& rdrCtx) const {
+	if (mBatches.empty()) { return; }
+
+	auto pCtx = rdrCtx.get_ctx();
+	auto& meshCBuf = rdrCtx.get_cbufs().mMeshCBuf;
+
+	meshCBuf.mData.wmtx = dx::XMMatrixIdentity();
+	meshCBuf.update(pCtx);
+	meshCBuf.set_VS(pCtx);
+
+	pCtx->IASetInputLayout(mpIL);
+	cBlendStates::get().set_opaque(pCtx);
+	mVtx.set(pCtx, 0, 0);
+
+	nMeshlet::sCullView cullView;
+	if (mCull) {
+		auto const& cam = rdrCtx.get_cbufs().mCameraCBuf.mData;
+		cullView.init(dx::XMMatrixIdentity(), cam.viewProj, cam.camPos);
+		cullView.mCones = false;
+	}
+
+	mStats.mDraws = 0;
+	mStats.mTrisDrawn = 0;
+	for (auto const& batch : mBatches) {
+		uint32_t rangesNum = 1;
+		if (mCull) {
+			rangesNum = nMeshlet::cull(&mRanges[batch.mRangeOffset], batch.mRangeNum, cullView, mpCullRanges.get());
+			if (rangesNum == 0) { continue; }
+		} else {
+			mpCullRanges[0] = { 0, batch.mIdxCount };
+		}
+
+		batch.mpMtl->apply(rdrCtx, batch.mMtlGrp);
+		pCtx->VSSetShader(batch.mpVS->asVS(), nullptr, 0);
+		mIdx.set(pCtx, batch.mIdxOffset, (DXGI_FORMAT)batch.mIdxFormat);
+		pCtx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		for (uint32_t i = 0; i < rangesNum; ++i) {
+			auto const& range = mpCullRanges[i];
+			pCtx->DrawIndexed(range.mIdxCount, range.mIdxStart, batch.mBaseVtx);
+			mStats.mDraws++;
+			mStats.mTrisDrawn += range.mIdxCount / 3;
+		}
+	}
+}
+
+void cStaticBatch::dbg_ui() {
+	if (mBatches.empty()) { return; }
+	ImGui::Begin("static batch");
+	ImGui::Checkbox("cull", &mCull);
+	ImGui::LabelText("objects", "%u", mStats.mObjects);
+	ImGui::LabelText("draws", "%u -> %u batches", mStats.mDrawsBefore, mStats.mBatches);
+	ImGui::LabelText("frame draws", "%u", mStats.mDraws);
+	ImGui::LabelText("frame tris", "%u/%u", mStats.mTrisDrawn, mStats.mTrisTotal);
+	ImGui::End();
+}
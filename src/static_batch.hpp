@@ -0,0 +1,72 @@
+#include <memory>
+#include <vector>
+
+class cModelData;
+class cModelMaterial;
+class cShader;
+class cRdrContext;
+
+struct sStaticBatchStats {
+	uint32_t mObjects = 0;
+	uint32_t mBatches = 0;
+	// Draws of the added models when drawn one by one, one per group
+	uint32_t mDrawsBefore = 0;
+	// Draws and triangles of the last frame, after culling
+	uint32_t mDraws = 0;
+	uint32_t mTrisDrawn = 0;
+	uint32_t mTrisTotal = 0;
+};
+
+// Merges groups of static models which share a material into combined vertex and index buffers.
+// World transforms are baked into the vertices at build time. Every source group keeps its
+// index range with world bounds, visible adjacent ranges are drawn together.
+class cStaticBatch : noncopyable {
+	struct sObject {
+		cModelData const* mpData;
+		cModelMaterial const* mpMtl;
+		DirectX::XMMATRIX mWmtx;
+	};
+
+	struct sBatch {
+		// Material is applied from the first merged group
+		cModelMaterial const* mpMtl;
+		uint32_t mMtlGrp;
+		// Variant of the material vertex shader for the combined vertex format
+		cShader* mpVS;
+		uint32_t mBaseVtx;
+		uint32_t mIdxFormat;
+		uint32_t mIdxOffset;
+		uint32_t mIdxCount;
+		// Source group ranges in mRanges
+		uint32_t mRangeOffset;
+		uint32_t mRangeNum;
+	};
+
+	std::vector<sObject> mObjects;
+	std::vector<sBatch> mBatches;
+	// One per source group, in world space and relative to the batch start.
+	// Cones are disabled, they are culled by the meshlet frustum test.
+	std::vector<sMeshlet> mRanges;
+	mutable std::unique_ptr<nMeshlet::sRange[]> mpCullRanges;
+	mutable sStaticBatchStats mStats;
+
+	uint32_t mVtxFmt = 0;
+	cVertexBuffer mVtx;
+	cIndexBuffer mIdx;
+	com_ptr<ID3D11InputLayout> mpIL;
+
+public:
+	bool mCull = true;
+
+	// Models need the import source kept, see cModelData::mKeepSrc. Skinned models and models
+	// with depth sorted groups are rejected.
+	bool add(cModelData const& data, cModelMaterial const& mtl, DirectX::FXMMATRIX wmtx);
+	// Creates the buffers for all added models, their source can be released afterwards
+	bool build();
+	void deinit();
+
+	void disp(cRdrContext const& rdrCtx) const;
+
+	sStaticBatchStats const& get_stats() const { return mStats; }
+	void dbg_ui();
+};
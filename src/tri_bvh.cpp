@@ -0,0 +1,572 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "model_src.hpp"
+#include "tri_bvh.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+namespace dx = DirectX;
+
+static const uint32_t BIN_NUM = 16;
+// Ranges at least this large are binned in parallel
+static const uint32_t PAR_BIN_MIN = 64 * 1024;
+static const uint32_t PAR_BIN_GRAIN = 16 * 1024;
+// Subtrees of at most this many triangles are built as one task
+static const uint32_t TASK_TRIS = 16 * 1024;
+// Deeper nodes split at the median, which bounds the depth for the traversal stack
+static const uint32_t MAX_SAH_DEPTH = 48;
+static const float TRAVERSAL_COST = 1.0f;
+
+struct sBox {
+	float mMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float mMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	void add(float const* pMin, float const* pMax) {
+		for (int i = 0; i < 3; ++i) {
+			mMin[i] = std::min(mMin[i], pMin[i]);
+			mMax[i] = std::max(mMax[i], pMax[i]);
+		}
+	}
+	void add(sBox const& box) { add(box.mMin, box.mMax); }
+	void add(float const* pPt) { add(pPt, pPt); }
+
+	float get_area() const {
+		const float ex = mMax[0] - mMin[0];
+		const float ey = mMax[1] - mMin[1];
+		const float ez = mMax[2] - mMin[2];
+		return ex < 0.0f ? 0.0f : 2.0f * (ex * ey + ey * ez + ez * ex);
+	}
+};
+
+// Binary node of the build, inner nodes have mCount 0.
+// mLeft of a task placeholder is the task index, its mCount is TASK_NODE.
+struct sBuildNode {
+	sBox mBox;
+	uint32_t mLeft;
+	uint32_t mRight;
+	uint32_t mFirst;
+	uint32_t mCount;
+};
+static const uint32_t TASK_NODE = UINT32_MAX;
+
+struct sBins {
+	sBox mBox[3][BIN_NUM];
+	uint32_t mCount[3][BIN_NUM] = {};
+};
+
+struct sBuildTask {
+	uint32_t mNode;
+	uint32_t mFirst;
+	uint32_t mCount;
+	uint32_t mDepth;
+	std::vector<sBuildNode> mNodes;
+};
+
+class cBvhBuilder {
+	std::vector<float> mCent;
+	std::vector<float> mTriMin;
+	std::vector<float> mTriMax;
+
+public:
+	std::vector<uint32_t> mPrims;
+
+	cBvhBuilder(std::vector<vec3> const& corners) {
+		const uint32_t num = (uint32_t)corners.size() / 3;
+		mCent.resize(size_t(num) * 3);
+		mTriMin.resize(size_t(num) * 3);
+		mTriMax.resize(size_t(num) * 3);
+		mPrims.resize(num);
+		nParallel::for_ranges(num, PAR_BIN_GRAIN, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				float const* p0 = &corners[i * 3 + 0].x;
+				float const* p1 = &corners[i * 3 + 1].x;
+				float const* p2 = &corners[i * 3 + 2].x;
+				for (int j = 0; j < 3; ++j) {
+					const float lo = std::min(p0[j], std::min(p1[j], p2[j]));
+					const float hi = std::max(p0[j], std::max(p1[j], p2[j]));
+					mTriMin[i * 3 + j] = lo;
+					mTriMax[i * 3 + j] = hi;
+					mCent[i * 3 + j] = 0.5f * (lo + hi);
+				}
+				mPrims[i] = i;
+			}
+		});
+	}
+
+	void calc_bounds(uint32_t first, uint32_t count, sBox& box, sBox& centBox) const {
+		auto bound = [&](uint32_t begin, uint32_t end, sBox& b, sBox& cb) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const uint32_t prim = mPrims[first + i];
+				b.add(&mTriMin[prim * 3], &mTriMax[prim * 3]);
+				cb.add(&mCent[prim * 3]);
+			}
+		};
+		if (count < PAR_BIN_MIN) {
+			bound(0, count, box, centBox);
+			return;
+		}
+		const uint32_t rangesNum = (count + PAR_BIN_GRAIN - 1) / PAR_BIN_GRAIN;
+		std::vector<sBox> boxes(rangesNum * 2);
+		nParallel::for_ranges(count, PAR_BIN_GRAIN, [&](uint32_t begin, uint32_t end) {
+			const uint32_t r = begin / PAR_BIN_GRAIN;
+			bound(begin, end, boxes[r * 2], boxes[r * 2 + 1]);
+		});
+		for (uint32_t r = 0; r < rangesNum; ++r) {
+			box.add(boxes[r * 2]);
+			centBox.add(boxes[r * 2 + 1]);
+		}
+	}
+
+	int get_bin(uint32_t prim, int axis, sBox const& centBox) const {
+		const float extent = centBox.mMax[axis] - centBox.mMin[axis];
+		const float scale = BIN_NUM * (1.0f - 1e-5f) / extent;
+		const int bin = (int)((mCent[prim * 3 + axis] - centBox.mMin[axis]) * scale);
+		return std::min(std::max(bin, 0), (int)BIN_NUM - 1);
+	}
+
+	void calc_bins(uint32_t first, uint32_t count, sBox const& centBox, sBins& bins) const {
+		auto bin = [&](uint32_t begin, uint32_t end, sBins& b) {
+			for (uint32_t i = begin; i < end; ++i) {
+				const uint32_t prim = mPrims[first + i];
+				for (int axis = 0; axis < 3; ++axis) {
+					if (centBox.mMax[axis] <= centBox.mMin[axis]) { continue; }
+					const int k = get_bin(prim, axis, centBox);
+					b.mBox[axis][k].add(&mTriMin[prim * 3], &mTriMax[prim * 3]);
+					b.mCount[axis][k]++;
+				}
+			}
+		};
+		if (count < PAR_BIN_MIN) {
+			bin(0, count, bins);
+			return;
+		}
+		const uint32_t rangesNum = (count + PAR_BIN_GRAIN - 1) / PAR_BIN_GRAIN;
+		std::vector<sBins> rangeBins(rangesNum);
+		nParallel::for_ranges(count, PAR_BIN_GRAIN, [&](uint32_t begin, uint32_t end) {
+			bin(begin, end, rangeBins[begin / PAR_BIN_GRAIN]);
+		});
+		for (auto const& rb : rangeBins) {
+			for (int axis = 0; axis < 3; ++axis) {
+				for (uint32_t k = 0; k < BIN_NUM; ++k) {
+					bins.mBox[axis][k].add(rb.mBox[axis][k]);
+					bins.mCount[axis][k] += rb.mCount[axis][k];
+				}
+			}
+		}
+	}
+
+	// Partitions the range and returns the size of the left part, 0 makes a leaf
+	uint32_t split(uint32_t first, uint32_t count, uint32_t depth, sBox const& box, sBox const& centBox) {
+		int axis = -1;
+		uint32_t splitBin = 0;
+		if (depth < MAX_SAH_DEPTH) {
+			sBins bins;
+			calc_bins(first, count, centBox, bins);
+
+			float bestCost = FLT_MAX;
+			for (int a = 0; a < 3; ++a) {
+				if (centBox.mMax[a] <= centBox.mMin[a]) { continue; }
+				sBox rightBox[BIN_NUM];
+				uint32_t rightCount[BIN_NUM];
+				sBox accBox;
+				uint32_t accCount = 0;
+				for (uint32_t k = BIN_NUM - 1; k > 0; --k) {
+					accBox.add(bins.mBox[a][k]);
+					accCount += bins.mCount[a][k];
+					rightBox[k] = accBox;
+					rightCount[k] = accCount;
+				}
+				accBox = sBox();
+				accCount = 0;
+				for (uint32_t k = 1; k < BIN_NUM; ++k) {
+					accBox.add(bins.mBox[a][k - 1]);
+					accCount += bins.mCount[a][k - 1];
+					if (accCount == 0 || rightCount[k] == 0) { continue; }
+					const float cost = accCount * accBox.get_area() + rightCount[k] * rightBox[k].get_area();
+					if (cost < bestCost) {
+						bestCost = cost;
+						axis = a;
+						splitBin = k;
+					}
+				}
+			}
+
+			const float area = box.get_area();
+			const float splitCost = TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+			if (count <= cTriBvh::MAX_LEAF_TRIS && (axis < 0 || splitCost >= (float)count)) { return 0; }
+
+			if (axis >= 0) {
+				uint32_t* pBegin = &mPrims[first];
+				uint32_t* pMid = std::partition(pBegin, pBegin + count, [&](uint32_t prim) {
+					return get_bin(prim, axis, centBox) < (int)splitBin;
+				});
+				return (uint32_t)(pMid - pBegin);
+			}
+		} else if (count <= cTriBvh::MAX_LEAF_TRIS) {
+			return 0;
+		}
+
+		// Median of the longest centroid axis, also separates coincident centroids
+		int longest = 0;
+		for (int a = 1; a < 3; ++a) {
+			if (centBox.mMax[a] - centBox.mMin[a] > centBox.mMax[longest] - centBox.mMin[longest]) { longest = a; }
+		}
+		const uint32_t half = count / 2;
+		uint32_t* pBegin = &mPrims[first];
+		std::nth_element(pBegin, pBegin + half, pBegin + count, [&](uint32_t a, uint32_t b) {
+			const float ca = mCent[a * 3 + longest];
+			const float cb = mCent[b * 3 + longest];
+			return ca < cb || (ca == cb && a < b);
+		});
+		return half;
+	}
+
+	uint32_t build_rec(std::vector<sBuildNode>& nodes, uint32_t first, uint32_t count, uint32_t depth) {
+		const uint32_t idx = (uint32_t)nodes.size();
+		nodes.push_back({});
+		sBox centBox;
+		calc_bounds(first, count, nodes[idx].mBox, centBox);
+		nodes[idx].mFirst = first;
+		nodes[idx].mCount = count;
+
+		const uint32_t leftNum = split(first, count, depth, nodes[idx].mBox, centBox);
+		if (leftNum == 0) { return idx; }
+
+		const uint32_t left = build_rec(nodes, first, leftNum, depth + 1);
+		const uint32_t right = build_rec(nodes, first + leftNum, count - leftNum, depth + 1);
+		nodes[idx].mLeft = left;
+		nodes[idx].mRight = right;
+		nodes[idx].mCount = 0;
+		return idx;
+	}
+
+	// Splits the top levels serially with parallel binning, smaller subtrees become tasks
+	uint32_t build_top(std::vector<sBuildNode>& nodes, std::vector<sBuildTask>& tasks, uint32_t first, uint32_t count, uint32_t depth) {
+		const uint32_t idx = (uint32_t)nodes.size();
+		nodes.push_back({});
+		if (count <= TASK_TRIS) {
+			nodes[idx].mLeft = (uint32_t)tasks.size();
+			nodes[idx].mCount = TASK_NODE;
+			tasks.push_back({ idx, first, count, depth, {} });
+			return idx;
+		}
+
+		sBox centBox;
+		calc_bounds(first, count, nodes[idx].mBox, centBox);
+		const uint32_t leftNum = split(first, count, depth, nodes[idx].mBox, centBox);
+		const uint32_t left = build_top(nodes, tasks, first, leftNum, depth + 1);
+		const uint32_t right = build_top(nodes, tasks, first + leftNum, count - leftNum, depth + 1);
+		nodes[idx].mLeft = left;
+		nodes[idx].mRight = right;
+		nodes[idx].mFirst = first;
+		nodes[idx].mCount = 0;
+		return idx;
+	}
+};
+
+// Task roots replace their placeholders, the other task nodes are appended
+static std::vector<sBuildNode> stitch(std::vector<sBuildNode>&& top, std::vector<sBuildTask>& tasks) {
+	std::vector<sBuildNode> nodes = std::move(top);
+	for (auto& task : tasks) {
+		const uint32_t offset = (uint32_t)nodes.size() - 1;
+		auto fix = [&](sBuildNode node) {
+			if (node.mCount == 0) {
+				node.mLeft += offset;
+				node.mRight += offset;
+			}
+			return node;
+		};
+		nodes[task.mNode] = fix(task.mNodes[0]);
+		for (size_t i = 1; i < task.mNodes.size(); ++i) {
+			nodes.push_back(fix(task.mNodes[i]));
+		}
+	}
+	return nodes;
+}
+
+// Inner children with the largest area are opened until the node has four
+uint32_t cTriBvh::collapse(std::vector<sBuildNode> const& bin, uint32_t binIdx, uint32_t depth) {
+	mStats.mDepth = std::max(mStats.mDepth, depth);
+
+	uint32_t children[4];
+	uint32_t childNum = 0;
+	if (bin[binIdx].mCount) {
+		children[childNum++] = binIdx;
+	} else {
+		children[childNum++] = bin[binIdx].mLeft;
+		children[childNum++] = bin[binIdx].mRight;
+		while (childNum < 4) {
+			int open = -1;
+			float openArea = -1.0f;
+			for (uint32_t i = 0; i < childNum; ++i) {
+				sBuildNode const& c = bin[children[i]];
+				if (c.mCount == 0 && c.mBox.get_area() > openArea) {
+					open = (int)i;
+					openArea = c.mBox.get_area();
+				}
+			}
+			if (open < 0) { break; }
+			const uint32_t opened = children[open];
+			children[open] = bin[opened].mLeft;
+			children[childNum++] = bin[opened].mRight;
+		}
+	}
+
+	const uint32_t idx = (uint32_t)mNodes.size();
+	mNodes.emplace_back();
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i >= childNum) {
+			sNode& node = mNodes[idx];
+			node.mMinX[i] = node.mMinY[i] = node.mMinZ[i] = FLT_MAX;
+			node.mMaxX[i] = node.mMaxY[i] = node.mMaxZ[i] = -FLT_MAX;
+			node.mChild[i] = INVALID;
+			node.mCount[i] = 0;
+			continue;
+		}
+
+		sBuildNode const& c = bin[children[i]];
+		uint32_t child = c.mFirst;
+		uint8_t count = (uint8_t)c.mCount;
+		if (c.mCount) {
+			mStats.mLeaves++;
+		} else {
+			// mNodes may grow, the node is written after
+			child = collapse(bin, children[i], depth + 1);
+		}
+		sNode& node = mNodes[idx];
+		node.mMinX[i] = c.mBox.mMin[0];
+		node.mMinY[i] = c.mBox.mMin[1];
+		node.mMinZ[i] = c.mBox.mMin[2];
+		node.mMaxX[i] = c.mBox.mMax[0];
+		node.mMaxY[i] = c.mBox.mMax[1];
+		node.mMaxZ[i] = c.mBox.mMax[2];
+		node.mChild[i] = child;
+		node.mCount[i] = count;
+	}
+	return idx;
+}
+
+void cTriBvh::clear() {
+	mNodes.clear();
+	mTris.clear();
+	mBounds.init_empty();
+	mStats = {};
+}
+
+void cTriBvh::build(sModelSrc const& src) {
+	clear();
+	const auto start = std::chrono::steady_clock::now();
+
+	uint32_t triNum = 0;
+	for (auto const& grp : src.mGroups) {
+		triNum += (uint32_t)grp.mIdx.size() / 3;
+	}
+	if (triNum == 0) { return; }
+
+	std::vector<vec3> corners(size_t(triNum) * 3);
+	std::vector<uint32_t> triGrp(triNum);
+	uint32_t triOffset = 0;
+	for (uint32_t g = 0; g < (uint32_t)src.mGroups.size(); ++g) {
+		auto const& idx = src.mGroups[g].mIdx;
+		const uint32_t grpTris = (uint32_t)idx.size() / 3;
+		nParallel::for_ranges(grpTris * 3, PAR_BIN_GRAIN, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; ++i) {
+				corners[size_t(triOffset) * 3 + i] = src.mVtx[idx[i]].pos;
+			}
+		});
+		std::fill_n(triGrp.begin() + triOffset, grpTris, g);
+		triOffset += grpTris;
+	}
+
+	cBvhBuilder builder(corners);
+	std::vector<sBuildNode> top;
+	std::vector<sBuildTask> tasks;
+	builder.build_top(top, tasks, 0, triNum, 0);
+	nParallel::for_ranges((uint32_t)tasks.size(), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			auto& task = tasks[i];
+			builder.build_rec(task.mNodes, task.mFirst, task.mCount, task.mDepth);
+		}
+	});
+	const std::vector<sBuildNode> bin = stitch(std::move(top), tasks);
+
+	// Leaf ranges index the triangles in final primitive order
+	std::vector<uint32_t> grpFirst(src.mGroups.size());
+	for (uint32_t g = 1; g < (uint32_t)src.mGroups.size(); ++g) {
+		grpFirst[g] = grpFirst[g - 1] + (uint32_t)src.mGroups[g - 1].mIdx.size() / 3;
+	}
+	mTris.resize(triNum);
+	nParallel::for_ranges(triNum, PAR_BIN_GRAIN, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			const uint32_t prim = builder.mPrims[i];
+			const dx::XMVECTOR p0 = dx::XMLoadFloat3((dx::XMFLOAT3 const*)&corners[prim * 3 + 0]);
+			const dx::XMVECTOR p1 = dx::XMLoadFloat3((dx::XMFLOAT3 const*)&corners[prim * 3 + 1]);
+			const dx::XMVECTOR p2 = dx::XMLoadFloat3((dx::XMFLOAT3 const*)&corners[prim * 3 + 2]);
+			sTri& tri = mTris[i];
+			tri.mV0 = corners[prim * 3];
+			dx::XMStoreFloat3((dx::XMFLOAT3*)&tri.mE1, dx::XMVectorSubtract(p1, p0));
+			dx::XMStoreFloat3((dx::XMFLOAT3*)&tri.mE2, dx::XMVectorSubtract(p2, p0));
+			tri.mGrp = triGrp[prim];
+			tri.mTri = prim - grpFirst[tri.mGrp];
+		}
+	});
+
+	auto const& rootBox = bin[0].mBox;
+	mBounds.mMin = dx::XMVectorSet(rootBox.mMin[0], rootBox.mMin[1], rootBox.mMin[2], 0.0f);
+	mBounds.mMax = dx::XMVectorSet(rootBox.mMax[0], rootBox.mMax[1], rootBox.mMax[2], 0.0f);
+
+	// A root leaf still gets a node, so traversal always starts at node 0
+	collapse(bin, 0, 1);
+
+	mStats.mTris = triNum;
+	mStats.mNodes = (uint32_t)mNodes.size();
+	mStats.mBuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Double sided Moller-Trumbore
+static bool intersect_tri(vec3 const& v0, vec3 const& e1, vec3 const& e2, float const* o, float const* d, float tmax, float& t, float& u, float& v) {
+	const float p[3] = { d[1] * e2.z - d[2] * e2.y, d[2] * e2.x - d[0] * e2.z, d[0] * e2.y - d[1] * e2.x };
+	const float det = e1.x * p[0] + e1.y * p[1] + e1.z * p[2];
+	if (std::abs(det) < 1e-12f) { return false; }
+	const float invDet = 1.0f / det;
+	const float s[3] = { o[0] - v0.x, o[1] - v0.y, o[2] - v0.z };
+	u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+	if (u < 0.0f || u > 1.0f) { return false; }
+	const float q[3] = { s[1] * e1.z - s[2] * e1.y, s[2] * e1.x - s[0] * e1.z, s[0] * e1.y - s[1] * e1.x };
+	v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+	if (v < 0.0f || u + v > 1.0f) { return false; }
+	t = (e2.x * q[0] + e2.y * q[1] + e2.z * q[2]) * invDet;
+	return t >= 0.0f && t < tmax;
+}
+
+bool XM_CALLCONV cTriBvh::trace(dx::FXMVECTOR org, dx::FXMVECTOR dir, float tmax, sBvhHit* pHit) const {
+	if (mNodes.empty()) { return false; }
+
+	dx::XMFLOAT3 o, d;
+	dx::XMStoreFloat3(&o, org);
+	dx::XMStoreFloat3(&d, dir);
+	const dx::XMVECTOR invDir = dx::XMVectorReciprocal(dir);
+	const dx::XMVECTOR ox = dx::XMVectorSplatX(org);
+	const dx::XMVECTOR oy = dx::XMVectorSplatY(org);
+	const dx::XMVECTOR oz = dx::XMVectorSplatZ(org);
+	const dx::XMVECTOR idx = dx::XMVectorSplatX(invDir);
+	const dx::XMVECTOR idy = dx::XMVectorSplatY(invDir);
+	const dx::XMVECTOR idz = dx::XMVectorSplatZ(invDir);
+
+	float tBest = tmax;
+	bool found = false;
+	uint32_t stack[STACK_SIZE];
+	uint32_t sp = 0;
+	stack[sp++] = 0;
+	while (sp) {
+		sNode const& node = mNodes[stack[--sp]];
+
+		// Slab test of the four children at once
+		const dx::XMVECTOR tx0 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMinX), ox), idx);
+		const dx::XMVECTOR tx1 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMaxX), ox), idx);
+		const dx::XMVECTOR ty0 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMinY), oy), idy);
+		const dx::XMVECTOR ty1 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMaxY), oy), idy);
+		const dx::XMVECTOR tz0 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMinZ), oz), idz);
+		const dx::XMVECTOR tz1 = dx::XMVectorMultiply(dx::XMVectorSubtract(dx::XMLoadFloat4A((dx::XMFLOAT4A const*)node.mMaxZ), oz), idz);
+		const dx::XMVECTOR tNear = dx::XMVectorMax(
+			dx::XMVectorMax(dx::XMVectorMin(tx0, tx1), dx::XMVectorMin(ty0, ty1)),
+			dx::XMVectorMax(dx::XMVectorMin(tz0, tz1), dx::XMVectorZero()));
+		const dx::XMVECTOR tFar = dx::XMVectorMin(
+			dx::XMVectorMin(dx::XMVectorMax(tx0, tx1), dx::XMVectorMax(ty0, ty1)),
+			dx::XMVectorMin(dx::XMVectorMax(tz0, tz1), dx::XMVectorReplicate(tBest)));
+		dx::XMFLOAT4A nearT;
+		dx::XMUINT4 mask;
+		dx::XMStoreFloat4A(&nearT, tNear);
+		dx::XMStoreUInt4(&mask, dx::XMVectorLessOrEqual(tNear, tFar));
+		uint32_t const* pMask = &mask.x;
+		float const* pNear = &nearT.x;
+
+		// Leaves first, their hits shorten the ray for the inner children
+		for (uint32_t i = 0; i < 4; ++i) {
+			if (!pMask[i] || !node.mCount[i]) { continue; }
+			for (uint32_t j = 0; j < node.mCount[i]; ++j) {
+				sTri const& tri = mTris[node.mChild[i] + j];
+				float t, u, v;
+				if (!intersect_tri(tri.mV0, tri.mE1, tri.mE2, &o.x, &d.x, tBest, t, u, v)) { continue; }
+				if (!pHit) { return true; }
+				tBest = t;
+				found = true;
+				*pHit = { t, u, v, tri.mGrp, tri.mTri };
+			}
+		}
+
+		// Inner children are pushed far to near, the nearest is popped first
+		uint32_t inner[4];
+		float innerNear[4];
+		uint32_t innerNum = 0;
+		for (uint32_t i = 0; i < 4; ++i) {
+			if (!pMask[i] || node.mCount[i] || node.mChild[i] == INVALID || pNear[i] > tBest) { continue; }
+			uint32_t k = innerNum++;
+			while (k > 0 && innerNear[k - 1] < pNear[i]) {
+				inner[k] = inner[k - 1];
+				innerNear[k] = innerNear[k - 1];
+				--k;
+			}
+			inner[k] = node.mChild[i];
+			innerNear[k] = pNear[i];
+		}
+		assert(sp + innerNum <= STACK_SIZE);
+		for (uint32_t i = 0; i < innerNum; ++i) {
+			stack[sp++] = inner[i];
+		}
+	}
+	return found;
+}
+
+sBvhBench cTriBvh::bench(uint32_t num) const {
+	sBvhBench res;
+	if (mNodes.empty() || num == 0) { return res; }
+
+	// Fixed seed, runs are comparable
+	uint32_t state = 0x9E3779B9u;
+	auto rnd = [&state]() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	};
+	auto rnd_dir = [&]() {
+		const float z = rnd() * 2.0f - 1.0f;
+		const float a = rnd() * dx::XM_2PI;
+		const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+		return dx::XMVectorSet(r * std::cos(a), r * std::sin(a), z, 0.0f);
+	};
+
+	const dx::XMVECTOR center = mBounds.get_center();
+	const float radius = dx::XMVectorGetX(dx::XMVector3Length(mBounds.get_extents()));
+	std::vector<dx::XMVECTOR> rays(size_t(num) * 2);
+	for (uint32_t i = 0; i < num; ++i) {
+		const dx::XMVECTOR org = dx::XMVectorAdd(center, dx::XMVectorScale(rnd_dir(), radius * 2.0f));
+		const dx::XMVECTOR target = dx::XMVectorAdd(center, dx::XMVectorScale(rnd_dir(), radius * 0.5f * rnd()));
+		rays[i * 2] = org;
+		rays[i * 2 + 1] = dx::XMVectorSubtract(target, org);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < num; ++i) {
+		sBvhHit hit;
+		res.mHits += intersect(rays[i * 2], rays[i * 2 + 1], FLT_MAX, hit) ? 1 : 0;
+	}
+	const double closestSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < num; ++i) {
+		occluded(rays[i * 2], rays[i * 2 + 1], FLT_MAX);
+	}
+	const double anySec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	res.mRays = num;
+	res.mClosestPerSec = num / std::max(closestSec, 1e-9);
+	res.mAnyPerSec = num / std::max(anySec, 1e-9);
+	return res;
+}
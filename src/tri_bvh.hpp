@@ -0,0 +1,93 @@
+#include <vector>
+
+struct sModelSrc;
+struct sBuildNode;
+
+struct sBvhHit {
+	float mT;
+	// Barycentrics of the second and third corner
+	float mU;
+	float mV;
+	uint32_t mGrp;
+	// Triangle of the group, in the final index order
+	uint32_t mTri;
+};
+
+struct sBvhStats {
+	uint32_t mTris = 0;
+	uint32_t mNodes = 0;
+	uint32_t mLeaves = 0;
+	uint32_t mDepth = 0;
+	double mBuildSeconds = 0.0;
+};
+
+struct sBvhBench {
+	uint32_t mRays = 0;
+	uint32_t mHits = 0;
+	double mClosestPerSec = 0.0;
+	double mAnyPerSec = 0.0;
+};
+
+// Four-wide BVH over the triangles of all groups of a model, built with binned SAH.
+// Rays are in model space, t is in units of the direction so it stays valid under affine transforms.
+// Triangles are double sided.
+class cTriBvh {
+public:
+	static const uint32_t MAX_LEAF_TRIS = 4;
+	static const uint32_t STACK_SIZE = 256;
+	static const uint32_t INVALID = UINT32_MAX;
+
+private:
+	struct alignas(16) sNode {
+		// Boxes of the four children as structure of arrays for the SIMD slab test
+		float mMinX[4];
+		float mMinY[4];
+		float mMinZ[4];
+		float mMaxX[4];
+		float mMaxY[4];
+		float mMaxZ[4];
+		// Node of inner children, first triangle of leaves, INVALID for empty slots
+		uint32_t mChild[4];
+		// Triangles of leaves, 0 for inner children
+		uint8_t mCount[4];
+	};
+
+	// Corner and edges for the Moller-Trumbore test
+	struct sTri {
+		vec3 mV0;
+		vec3 mE1;
+		vec3 mE2;
+		uint32_t mGrp;
+		uint32_t mTri;
+	};
+
+	std::vector<sNode> mNodes;
+	std::vector<sTri> mTris;
+	sAABB mBounds;
+	sBvhStats mStats;
+
+	uint32_t collapse(std::vector<sBuildNode> const& bin, uint32_t binIdx, uint32_t depth);
+	bool XM_CALLCONV trace(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax, sBvhHit* pHit) const;
+
+public:
+	cTriBvh() { mBounds.init_empty(); }
+
+	// Triangles of the mIdx lists of all groups, ranges are built in parallel
+	void build(sModelSrc const& src);
+	void clear();
+	bool is_empty() const { return mNodes.empty(); }
+
+	// Closest hit with t in [0, tmax)
+	bool XM_CALLCONV intersect(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax, sBvhHit& hit) const {
+		return trace(org, dir, tmax, &hit);
+	}
+	// Any hit with t in [0, tmax), stops at the first one
+	bool XM_CALLCONV occluded(DirectX::FXMVECTOR org, DirectX::FXMVECTOR dir, float tmax) const {
+		return trace(org, dir, tmax, nullptr);
+	}
+
+	sAABB const& get_bounds() const { return mBounds; }
+	sBvhStats const& get_stats() const { return mStats; }
+	// Casts num rays on the calling thread, from around the bounds through points inside them
+	sBvhBench bench(uint32_t num) const;
+};
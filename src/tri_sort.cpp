@@ -0,0 +1,152 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "gfx.hpp"
+#include "model_src.hpp"
+#include "tri_sort.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace dx = DirectX;
+
+bool cTriSorter::init(sModelSrcGroup const& srcGrp, sModelVtx const* pVtx, uint32_t baseVtx, DXGI_FORMAT idxFormat) {
+	deinit();
+	const uint32_t triNum = (uint32_t)srcGrp.mIdx.size() / 3;
+	if (triNum == 0) { return false; }
+
+	mTriNum = triNum;
+	mIdxFormat = idxFormat;
+	mpTris = std::make_unique<sTri[]>(triNum);
+	mpTmpTris = std::make_unique<sTri[]>(triNum);
+	mpKeys = std::make_unique<uint16_t[]>(triNum);
+	mpOffsets = std::make_unique<uint32_t[]>(KEY_NUM);
+
+	mBounds.init_empty();
+	for (uint32_t i = 0; i < triNum; ++i) {
+		sTri& tri = mpTris[i];
+		dx::XMVECTOR sum = dx::XMVectorZero();
+		for (uint32_t j = 0; j < 3; ++j) {
+			const uint32_t idx = srcGrp.mIdx[i * 3 + j];
+			sum = dx::XMVectorAdd(sum, dx::XMLoadFloat3((dx::XMFLOAT3 const*)&pVtx[idx].pos));
+			tri.mIdx[j] = idx - baseVtx;
+		}
+		const dx::XMVECTOR centroid = dx::XMVectorScale(sum, 1.0f / 3.0f);
+		dx::XMStoreFloat3((dx::XMFLOAT3*)&tri.mCentroid, centroid);
+		mBounds.add(centroid);
+	}
+
+	// Parts are drawn one by one with their own joints, triangles can't move between them
+	if (srcGrp.mSkinParts.empty()) {
+		mRanges.push_back({ 0, triNum, false });
+	} else {
+		for (auto const& part : srcGrp.mSkinParts) {
+			mRanges.push_back({ part.mIdxStart / 3, part.mIdxCount / 3, false });
+		}
+	}
+
+	mIdxBuf.init_write_only(get_gfx().get_dev(), triNum * 3, idxFormat);
+	mUploaded = false;
+	return true;
+}
+
+void cTriSorter::deinit() {
+	mTriNum = 0;
+	mpTris.reset();
+	mpTmpTris.reset();
+	mpKeys.reset();
+	mpOffsets.reset();
+	mRanges.clear();
+	mIdxBuf.deinit();
+	mUploaded = false;
+}
+
+bool XM_CALLCONV cTriSorter::sort(ID3D11DeviceContext* pCtx, dx::FXMVECTOR viewZ) {
+	if (!mTriNum) { return false; }
+
+	if (mUploaded && dx::XMVector4Equal(viewZ, dx::XMLoadFloat4(&mViewZ))) { return false; }
+	dx::XMStoreFloat4(&mViewZ, viewZ);
+
+	// Depth range of the bounds, far maps to key 0 so it's drawn first
+	const float centerZ = dx::XMVectorGetX(dx::XMVector3Dot(mBounds.get_center(), viewZ)) + mViewZ.w;
+	const float extentZ = dx::XMVectorGetX(dx::XMVector3Dot(mBounds.get_extents(), dx::XMVectorAbs(viewZ)));
+	const float scale = extentZ > 0.0f ? float(KEY_NUM - 1) / (2.0f * extentZ) : 0.0f;
+
+	uint32_t sortedNum = 0;
+	for (auto& range : mRanges) {
+		range.mSorted = sort_range(range, centerZ + extentZ, scale);
+		sortedNum += range.mSorted;
+	}
+	if (sortedNum) {
+		// Ranges in order were not scattered, the whole array is swapped
+		for (auto const& range : mRanges) {
+			if (!range.mSorted) {
+				::memcpy(&mpTmpTris[range.mTriStart], &mpTris[range.mTriStart], range.mTriNum * sizeof(sTri));
+			}
+		}
+		std::swap(mpTris, mpTmpTris);
+	} else if (mUploaded) {
+		return false;
+	}
+
+	upload(pCtx);
+	return true;
+}
+
+bool cTriSorter::sort_range(sRange const& range, float farZ, float scale) {
+	sTri const* pSrc = &mpTris[range.mTriStart];
+	sTri* pDst = &mpTmpTris[range.mTriStart];
+	uint16_t* pKeys = &mpKeys[range.mTriStart];
+	uint32_t* pOffsets = mpOffsets.get();
+	::memset(pOffsets, 0, KEY_NUM * sizeof(uint32_t));
+
+	const float maxKey = float(KEY_NUM - 1);
+	uint32_t descents = 0;
+	uint16_t prevKey = 0;
+	for (uint32_t i = 0; i < range.mTriNum; ++i) {
+		vec3 const& c = pSrc[i].mCentroid;
+		const float z = c.x * mViewZ.x + c.y * mViewZ.y + c.z * mViewZ.z + mViewZ.w;
+		const uint16_t key = (uint16_t)std::min(std::max((farZ - z) * scale, 0.0f), maxKey);
+		descents += key < prevKey;
+		prevKey = key;
+		pKeys[i] = key;
+		pOffsets[key]++;
+	}
+
+	if (descents == 0) { return false; }
+
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < KEY_NUM; ++i) {
+		const uint32_t cnt = pOffsets[i];
+		pOffsets[i] = sum;
+		sum += cnt;
+	}
+	for (uint32_t i = 0; i < range.mTriNum; ++i) {
+		pDst[pOffsets[pKeys[i]]++] = pSrc[i];
+	}
+	return true;
+}
+
+void cTriSorter::upload(ID3D11DeviceContext* pCtx) {
+	auto map = mIdxBuf.map(pCtx);
+	mUploaded = map.is_mapped();
+	if (!mUploaded) { return; }
+
+	if (mIdxFormat == DXGI_FORMAT_R32_UINT) {
+		uint32_t* pDst = reinterpret_cast<uint32_t*>(map.data());
+		for (uint32_t i = 0; i < mTriNum; ++i) {
+			uint32_t const* pIdx = mpTris[i].mIdx;
+			pDst[i * 3 + 0] = pIdx[0];
+			pDst[i * 3 + 1] = pIdx[1];
+			pDst[i * 3 + 2] = pIdx[2];
+		}
+	} else {
+		uint16_t* pDst = reinterpret_cast<uint16_t*>(map.data());
+		for (uint32_t i = 0; i < mTriNum; ++i) {
+			uint32_t const* pIdx = mpTris[i].mIdx;
+			pDst[i * 3 + 0] = (uint16_t)pIdx[0];
+			pDst[i * 3 + 1] = (uint16_t)pIdx[1];
+			pDst[i * 3 + 2] = (uint16_t)pIdx[2];
+		}
+	}
+}
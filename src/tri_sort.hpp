@@ -0,0 +1,69 @@
+#include <memory>
+#include <vector>
+
+struct sModelSrcGroup;
+struct sModelVtx;
+
+struct sTriSortStats {
+	uint32_t mTris = 0;
+	// Groups sorted and uploaded in the last frame, and groups whose last order still held
+	uint32_t mSorted = 0;
+	uint32_t mKept = 0;
+	double mSeconds = 0.0;
+};
+
+// Back to front order of the triangles of a group, in a dynamic index buffer drawn instead of the group's range.
+// Depth at triangle centroids is quantized over the group bounds to KEY_BITS and sorted with a single radix
+// digit. Triangles are kept in the last order, so the scatter of a frame is nearly sequential and triangles
+// with equal keys don't flicker. Nothing is sorted or uploaded when the view is unchanged or the last order
+// still holds. Skin parts are sorted within their own ranges.
+class cTriSorter : noncopyable {
+public:
+	static const uint32_t KEY_BITS = 12;
+	static const uint32_t KEY_NUM = 1u << KEY_BITS;
+
+private:
+	struct sTri {
+		vec3 mCentroid;
+		// Relative to the group base vertex
+		uint32_t mIdx[3];
+	};
+
+	struct sRange {
+		uint32_t mTriStart;
+		uint32_t mTriNum;
+		// Scattered to mpTmpTris by the last sort
+		bool mSorted;
+	};
+
+	uint32_t mTriNum = 0;
+	// In the current order, and the scatter target of the next sort
+	std::unique_ptr<sTri[]> mpTris;
+	std::unique_ptr<sTri[]> mpTmpTris;
+	std::unique_ptr<uint16_t[]> mpKeys;
+	std::unique_ptr<uint32_t[]> mpOffsets;
+	std::vector<sRange> mRanges;
+	// Model space bounds of the centroids
+	sAABB mBounds;
+
+	DXGI_FORMAT mIdxFormat = DXGI_FORMAT_R16_UINT;
+	cIndexBuffer mIdxBuf;
+	DirectX::XMFLOAT4 mViewZ;
+	bool mUploaded = false;
+
+	// Scatters the range to mpTmpTris, returns false when it's already in order
+	bool sort_range(sRange const& range, float farZ, float scale);
+	void upload(ID3D11DeviceContext* pCtx);
+
+public:
+	bool init(sModelSrcGroup const& srcGrp, sModelVtx const* pVtx, uint32_t baseVtx, DXGI_FORMAT idxFormat);
+	void deinit();
+
+	// viewZ maps model space points to view depth, the third column of the model-view matrix.
+	// Returns false when the last order is kept.
+	bool XM_CALLCONV sort(ID3D11DeviceContext* pCtx, DirectX::FXMVECTOR viewZ);
+
+	uint32_t get_tri_num() const { return mTriNum; }
+	cIndexBuffer const& get_idx() const { return mIdxBuf; }
+	DXGI_FORMAT get_idx_format() const { return mIdxFormat; }
+};
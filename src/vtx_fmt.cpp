@@ -0,0 +1,428 @@
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "vtx_fmt.hpp"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+namespace dx = DirectX;
+namespace dxpv = DirectX::PackedVector;
+
+namespace nVtxFmt {
+
+// Half precision step at 2.0 is 1/512, about a texel of a 1K texture
+static const float UV_HALF_MAX = 2.0f;
+static const float QTANGENT_BIAS = 1.0f / 32767.0f;
+
+static const D3D11_INPUT_ELEMENT_DESC s_descF32[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, pos), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, nrm), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(sModelVtx, uv), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(sModelVtx, tgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, bitgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 0, offsetof(sModelVtx, uv1), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "COLOR", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtx, clr), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDINDEX", 0, DXGI_FORMAT_R32G32B32A32_SINT, 0, offsetof(sModelVtx, jidx), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDWEIGHT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, offsetof(sModelVtx, jwgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+static const D3D11_INPUT_ELEMENT_DESC s_descPacked[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtxPacked, pos), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "QTANGENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, offsetof(sModelVtxPacked, qtgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(sModelVtxPacked, uv), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(sModelVtxPacked, uv1), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, offsetof(sModelVtxPacked, clr), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+static const D3D11_INPUT_ELEMENT_DESC s_descPackedSkin[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(sModelVtxPackedSkin, pos), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "QTANGENT", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, offsetof(sModelVtxPackedSkin, qtgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(sModelVtxPackedSkin, uv), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(sModelVtxPackedSkin, uv1), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, offsetof(sModelVtxPackedSkin, clr), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDINDEX", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, offsetof(sModelVtxPackedSkin, jidx), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDWEIGHT", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, offsetof(sModelVtxPackedSkin, jwgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+static const D3D11_INPUT_ELEMENT_DESC s_descDepth[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDINDEX", 0, DXGI_FORMAT_R8G8B8A8_UINT, 1, offsetof(sModelVtxJnt, jidx), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "BLENDWEIGHT", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 1, offsetof(sModelVtxJnt, jwgt), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+static const D3D11_INPUT_ELEMENT_DESC s_descInstance[] = {
+	{ "INSTANCE", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(sInstanceData, wmtx[0]), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(sInstanceData, wmtx[1]), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(sInstanceData, wmtx[2]), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "TINT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(sInstanceData, tint), D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+// "<name><suffix>.vs.cso", names without the extension are returned unchanged
+static std::string add_vs_suffix(std::string const& vsProg, cstr suffix) {
+	const std::string ext = ".vs.cso";
+	if (vsProg.size() < ext.size() || vsProg.compare(vsProg.size() - ext.size(), ext.size(), ext) != 0) {
+		return vsProg;
+	}
+	return vsProg.substr(0, vsProg.size() - ext.size()) + suffix + ext;
+}
+
+cstr get_name(eVtxFmt fmt) {
+	switch (fmt) {
+	case E_VTX_FMT_F32: return "f32";
+	case E_VTX_FMT_PACKED: return "packed";
+	case E_VTX_FMT_PACKED_SKIN: return "packed_skin";
+	default: return "unknown";
+	}
+}
+
+uint32_t get_size(eVtxFmt fmt) {
+	switch (fmt) {
+	case E_VTX_FMT_F32: return sizeof(sModelVtx);
+	case E_VTX_FMT_PACKED: return sizeof(sModelVtxPacked);
+	case E_VTX_FMT_PACKED_SKIN: return sizeof(sModelVtxPackedSkin);
+	default: return 0;
+	}
+}
+
+D3D11_INPUT_ELEMENT_DESC const* get_input_desc(eVtxFmt fmt, uint32_t& num) {
+	switch (fmt) {
+	case E_VTX_FMT_PACKED:
+		num = LENGTHOF_ARRAY(s_descPacked);
+		return s_descPacked;
+	case E_VTX_FMT_PACKED_SKIN:
+		num = LENGTHOF_ARRAY(s_descPackedSkin);
+		return s_descPackedSkin;
+	default:
+		num = LENGTHOF_ARRAY(s_descF32);
+		return s_descF32;
+	}
+}
+
+cstr get_layout_vs(eVtxFmt fmt) {
+	switch (fmt) {
+	case E_VTX_FMT_PACKED: return "model_solid_packed.vs.cso";
+	case E_VTX_FMT_PACKED_SKIN: return "model_skin_packed.vs.cso";
+	default: return "model_solid.vs.cso";
+	}
+}
+
+std::string get_vs_variant(std::string const& vsProg, eVtxFmt fmt) {
+	if (fmt == E_VTX_FMT_F32) { return vsProg; }
+	return add_vs_suffix(vsProg, "_packed");
+}
+
+D3D11_INPUT_ELEMENT_DESC const* get_depth_input_desc(bool isSkinned, uint32_t& num) {
+	num = isSkinned ? LENGTHOF_ARRAY(s_descDepth) : 1;
+	return s_descDepth;
+}
+
+cstr get_depth_layout_vs(bool isSkinned) {
+	return isSkinned ? "model_skin_depth.vs.cso" : "model_solid_depth.vs.cso";
+}
+
+std::string get_depth_vs_variant(std::string const& vsProg) {
+	return add_vs_suffix(vsProg, "_depth");
+}
+
+void get_inst_input_desc(eVtxFmt fmt, std::vector<D3D11_INPUT_ELEMENT_DESC>& desc) {
+	uint32_t num = 0;
+	auto pVtxDesc = get_input_desc(fmt, num);
+	desc.assign(pVtxDesc, pVtxDesc + num);
+	desc.insert(desc.end(), std::begin(s_descInstance), std::end(s_descInstance));
+}
+
+cstr get_inst_layout_vs(eVtxFmt fmt) {
+	switch (fmt) {
+	case E_VTX_FMT_F32: return "model_solid_inst.vs.cso";
+	case E_VTX_FMT_PACKED: return "model_solid_packed_inst.vs.cso";
+	default: return nullptr;
+	}
+}
+
+std::string get_inst_vs_variant(std::string const& vsProg) {
+	return add_vs_suffix(vsProg, "_inst");
+}
+
+eVtxFmt choose(sModelVtx const* pVtx, uint32_t num) {
+	bool isSkinned = false;
+	for (uint32_t i = 0; i < num; ++i) {
+		auto const& vtx = pVtx[i];
+
+		const bool uvFits = std::abs(vtx.uv.x) <= UV_HALF_MAX && std::abs(vtx.uv.y) <= UV_HALF_MAX
+			&& std::abs(vtx.uv1.x) <= UV_HALF_MAX && std::abs(vtx.uv1.y) <= UV_HALF_MAX;
+		if (!uvFits) { return E_VTX_FMT_F32; }
+
+		const bool clrFits = vtx.clr.x >= 0.0f && vtx.clr.x <= 1.0f
+			&& vtx.clr.y >= 0.0f && vtx.clr.y <= 1.0f
+			&& vtx.clr.z >= 0.0f && vtx.clr.z <= 1.0f;
+		if (!clrFits) { return E_VTX_FMT_F32; }
+
+		for (int j = 0; j < 4; ++j) {
+			if (vtx.jwgt[j] > 0.0f) {
+				if (vtx.jidx[j] < 0 || vtx.jidx[j] > 0xFF) { return E_VTX_FMT_F32; }
+				isSkinned = true;
+			}
+		}
+	}
+	return isSkinned ? E_VTX_FMT_PACKED_SKIN : E_VTX_FMT_PACKED;
+}
+
+// Orthonormal tangent frame, handedness is the sign of the bitangent against cross(n, t)
+static void ortho_frame(dx::FXMVECTOR nrm, dx::FXMVECTOR tgt, dx::FXMVECTOR bitgt,
+	dx::XMVECTOR& n, dx::XMVECTOR& t, dx::XMVECTOR& b, float& handedness) {
+	n = dx::XMVectorGetX(dx::XMVector3LengthSq(nrm)) > 1e-12f ? dx::XMVector3Normalize(nrm) : dx::g_XMIdentityR2;
+
+	t = dx::XMVectorSubtract(tgt, dx::XMVectorMultiply(n, dx::XMVector3Dot(n, tgt)));
+	if (dx::XMVectorGetX(dx::XMVector3LengthSq(t)) < 1e-12f) {
+		// Degenerate tangent, any perpendicular axis will do
+		const dx::XMVECTOR axis = std::abs(dx::XMVectorGetX(n)) < 0.9f ? dx::g_XMIdentityR0 : dx::g_XMIdentityR1;
+		t = dx::XMVector3Cross(n, axis);
+	}
+	t = dx::XMVector3Normalize(t);
+	b = dx::XMVector3Cross(n, t);
+	handedness = dx::XMVectorGetX(dx::XMVector3Dot(b, bitgt)) < 0.0f ? -1.0f : 1.0f;
+}
+
+void encode_qtangent(DirectX::FXMVECTOR nrm, DirectX::FXMVECTOR tgt, DirectX::FXMVECTOR bitgt, int16_t* pQ) {
+	dx::XMVECTOR n, t, b;
+	float handedness;
+	ortho_frame(nrm, tgt, bitgt, n, t, b, handedness);
+
+	// Rows map x, y, z to t, b, n
+	const dx::XMMATRIX frame(
+		dx::XMVectorSetW(t, 0.0f),
+		dx::XMVectorSetW(b, 0.0f),
+		dx::XMVectorSetW(n, 0.0f),
+		dx::g_XMIdentityR3);
+	dx::XMVECTOR q = dx::XMQuaternionNormalize(dx::XMQuaternionRotationMatrix(frame));
+	if (dx::XMVectorGetW(q) < 0.0f) {
+		q = dx::XMVectorNegate(q);
+	}
+	// w must not quantize to 0, otherwise handedness is lost
+	if (dx::XMVectorGetW(q) < QTANGENT_BIAS) {
+		const float scl = std::sqrt(1.0f - QTANGENT_BIAS * QTANGENT_BIAS);
+		q = dx::XMVectorSetW(dx::XMVectorScale(q, scl), QTANGENT_BIAS);
+	}
+	if (handedness < 0.0f) {
+		q = dx::XMVectorNegate(q);
+	}
+
+	dx::XMFLOAT4 qf;
+	dx::XMStoreFloat4(&qf, q);
+	float const* pQf = &qf.x;
+	for (int i = 0; i < 4; ++i) {
+		pQ[i] = (int16_t)std::lround(clamp(pQf[i], -1.0f, 1.0f) * 32767.0f);
+	}
+}
+
+void decode_qtangent(int16_t const* pQ, DirectX::XMVECTOR& nrm, DirectX::XMVECTOR& tgt, DirectX::XMVECTOR& bitgt) {
+	// Same as SNORM16 fetch in the shader
+	float qf[4];
+	for (int i = 0; i < 4; ++i) {
+		qf[i] = std::max(pQ[i] / 32767.0f, -1.0f);
+	}
+	const dx::XMVECTOR q = dx::XMQuaternionNormalize(dx::XMVectorSet(qf[0], qf[1], qf[2], qf[3]));
+	const float handedness = qf[3] < 0.0f ? -1.0f : 1.0f;
+
+	tgt = dx::XMVector3Rotate(dx::g_XMIdentityR0, q);
+	nrm = dx::XMVector3Rotate(dx::g_XMIdentityR2, q);
+	bitgt = dx::XMVectorScale(dx::XMVector3Cross(nrm, tgt), handedness);
+	tgt = dx::XMVectorSetW(tgt, handedness);
+}
+
+void encode_pos(sModelVtx const* pSrc, uint32_t num, vec3* pDst) {
+	for (uint32_t i = 0; i < num; ++i) {
+		pDst[i] = pSrc[i].pos;
+	}
+}
+
+void encode_jnt(sModelVtx const* pSrc, uint32_t num, sModelVtxJnt* pDst) {
+	for (uint32_t i = 0; i < num; ++i) {
+		auto const& src = pSrc[i];
+		auto& dst = pDst[i];
+		encode_weights(src.jwgt, dst.jwgt);
+		for (int j = 0; j < 4; ++j) {
+			dst.jidx[j] = dst.jwgt[j] ? (uint8_t)src.jidx[j] : 0;
+		}
+	}
+}
+
+void encode_weights(vec4 const& wgt, uint8_t* pW) {
+	float sum = 0.0f;
+	for (int i = 0; i < 4; ++i) {
+		sum += std::max(wgt[i], 0.0f);
+	}
+	if (sum <= 0.0f) {
+		pW[0] = pW[1] = pW[2] = pW[3] = 0;
+		return;
+	}
+
+	// Largest remainder rounding keeps the sum exactly 255
+	int q[4];
+	float rem[4];
+	int total = 0;
+	for (int i = 0; i < 4; ++i) {
+		const float w = std::max(wgt[i], 0.0f) / sum * 255.0f;
+		q[i] = (int)w;
+		rem[i] = w - q[i];
+		total += q[i];
+	}
+	while (total < 255) {
+		int best = 0;
+		for (int i = 1; i < 4; ++i) {
+			if (rem[i] > rem[best]) { best = i; }
+		}
+		q[best]++;
+		rem[best] = -1.0f;
+		total++;
+	}
+	for (int i = 0; i < 4; ++i) {
+		pW[i] = (uint8_t)q[i];
+	}
+}
+
+static uint8_t encode_unorm8(float v) {
+	return (uint8_t)std::lround(clamp(v, 0.0f, 1.0f) * 255.0f);
+}
+
+static dx::XMVECTOR load(vec3 const& v) {
+	return dx::XMVectorSet(v.x, v.y, v.z, 0.0f);
+}
+
+// Shared by sModelVtxPacked and sModelVtxPackedSkin
+template <typename T>
+static void encode_packed(sModelVtx const& src, T& dst) {
+	dst.pos = src.pos;
+	encode_qtangent(load(src.nrm), dx::XMLoadFloat4(&src.tgt.mVal), load(src.bitgt), dst.qtgt);
+	dst.uv[0] = dxpv::XMConvertFloatToHalf(src.uv.x);
+	dst.uv[1] = dxpv::XMConvertFloatToHalf(src.uv.y);
+	dst.uv1[0] = dxpv::XMConvertFloatToHalf(src.uv1.x);
+	dst.uv1[1] = dxpv::XMConvertFloatToHalf(src.uv1.y);
+	dst.clr[0] = encode_unorm8(src.clr.x);
+	dst.clr[1] = encode_unorm8(src.clr.y);
+	dst.clr[2] = encode_unorm8(src.clr.z);
+	dst.clr[3] = 0xFF;
+}
+
+template <typename T>
+static void decode_packed(T const& src, sModelVtx& dst) {
+	dst.pos = src.pos;
+	dx::XMVECTOR nrm, tgt, bitgt;
+	decode_qtangent(src.qtgt, nrm, tgt, bitgt);
+	dx::XMStoreFloat3((dx::XMFLOAT3*)&dst.nrm, nrm);
+	dx::XMStoreFloat4(&dst.tgt.mVal, tgt);
+	dx::XMStoreFloat3((dx::XMFLOAT3*)&dst.bitgt, bitgt);
+	dst.uv = { dxpv::XMConvertHalfToFloat(src.uv[0]), dxpv::XMConvertHalfToFloat(src.uv[1]) };
+	dst.uv1 = { dxpv::XMConvertHalfToFloat(src.uv1[0]), dxpv::XMConvertHalfToFloat(src.uv1[1]) };
+	dst.clr = { src.clr[0] / 255.0f, src.clr[1] / 255.0f, src.clr[2] / 255.0f };
+	dst.jidx = { { 0, 0, 0, 0 } };
+	dst.jwgt = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+}
+
+void encode(eVtxFmt fmt, sModelVtx const* pSrc, uint32_t num, void* pDst) {
+	switch (fmt) {
+	case E_VTX_FMT_F32:
+		::memcpy(pDst, pSrc, num * sizeof(sModelVtx));
+		break;
+	case E_VTX_FMT_PACKED: {
+		auto pPacked = static_cast<sModelVtxPacked*>(pDst);
+		for (uint32_t i = 0; i < num; ++i) {
+			encode_packed(pSrc[i], pPacked[i]);
+		}
+		break;
+	}
+	case E_VTX_FMT_PACKED_SKIN: {
+		auto pPacked = static_cast<sModelVtxPackedSkin*>(pDst);
+		for (uint32_t i = 0; i < num; ++i) {
+			auto const& src = pSrc[i];
+			auto& dst = pPacked[i];
+			encode_packed(src, dst);
+			encode_weights(src.jwgt, dst.jwgt);
+			for (int j = 0; j < 4; ++j) {
+				dst.jidx[j] = dst.jwgt[j] ? (uint8_t)src.jidx[j] : 0;
+			}
+		}
+		break;
+	}
+	default:
+		assert(false);
+	}
+}
+
+void decode(eVtxFmt fmt, void const* pSrc, uint32_t num, sModelVtx* pDst) {
+	switch (fmt) {
+	case E_VTX_FMT_F32:
+		::memcpy(pDst, pSrc, num * sizeof(sModelVtx));
+		break;
+	case E_VTX_FMT_PACKED: {
+		auto pPacked = static_cast<sModelVtxPacked const*>(pSrc);
+		for (uint32_t i = 0; i < num; ++i) {
+			decode_packed(pPacked[i], pDst[i]);
+		}
+		break;
+	}
+	case E_VTX_FMT_PACKED_SKIN: {
+		auto pPacked = static_cast<sModelVtxPackedSkin const*>(pSrc);
+		for (uint32_t i = 0; i < num; ++i) {
+			auto const& src = pPacked[i];
+			auto& dst = pDst[i];
+			decode_packed(src, dst);
+			for (int j = 0; j < 4; ++j) {
+				dst.jidx[j] = src.jidx[j];
+				dst.jwgt[j] = src.jwgt[j] / 255.0f;
+			}
+		}
+		break;
+	}
+	default:
+		assert(false);
+	}
+}
+
+static float dist(dx::FXMVECTOR a, dx::FXMVECTOR b) {
+	return dx::XMVectorGetX(dx::XMVector3Length(dx::XMVectorSubtract(a, b)));
+}
+
+sError round_trip_error(eVtxFmt fmt, sModelVtx const* pSrc, uint32_t num) {
+	std::vector<uint8_t> encoded(size_t(num) * get_size(fmt));
+	std::vector<sModelVtx> decoded(num);
+	encode(fmt, pSrc, num, encoded.data());
+	decode(fmt, encoded.data(), num, decoded.data());
+
+	sError err;
+	for (uint32_t i = 0; i < num; ++i) {
+		auto const& src = pSrc[i];
+		auto const& dst = decoded[i];
+
+		dx::XMVECTOR n, t, b;
+		float handedness;
+		ortho_frame(load(src.nrm), dx::XMLoadFloat4(&src.tgt.mVal), load(src.bitgt), n, t, b, handedness);
+		b = dx::XMVectorScale(b, handedness);
+
+		err.mPos = std::max(err.mPos, dist(load(src.pos), load(dst.pos)));
+		err.mNrm = std::max(err.mNrm, dist(n, load(dst.nrm)));
+		err.mTgt = std::max(err.mTgt, dist(t, dx::XMLoadFloat4(&dst.tgt.mVal)));
+		err.mTgt = std::max(err.mTgt, dist(b, load(dst.bitgt)));
+		err.mUV = std::max({ err.mUV,
+			std::abs(src.uv.x - dst.uv.x), std::abs(src.uv.y - dst.uv.y),
+			std::abs(src.uv1.x - dst.uv1.x), std::abs(src.uv1.y - dst.uv1.y) });
+		err.mClr = std::max(err.mClr, dist(load(src.clr), load(dst.clr)));
+
+		if (fmt == E_VTX_FMT_PACKED_SKIN) {
+			float sum = 0.0f;
+			for (int j = 0; j < 4; ++j) {
+				sum += std::max(src.jwgt[j], 0.0f);
+			}
+			for (int j = 0; j < 4; ++j) {
+				const float w = sum > 0.0f ? std::max(src.jwgt[j], 0.0f) / sum : 0.0f;
+				err.mWgt = std::max(err.mWgt, std::abs(w - dst.jwgt[j]));
+			}
+		}
+	}
+	return err;
+}
+
+} // namespace nVtxFmt
@@ -0,0 +1,100 @@
+#include <string>
+#include <vector>
+
+// Vertex layouts of model vertex buffers, chosen per mesh at import.
+// sModelVtx stays the import and CPU side representation.
+enum eVtxFmt : uint32_t {
+	E_VTX_FMT_F32 = 0,    // sModelVtx
+	E_VTX_FMT_PACKED,     // sModelVtxPacked
+	E_VTX_FMT_PACKED_SKIN,// sModelVtxPackedSkin
+
+	E_VTX_FMT_NUM
+};
+
+// Normal, tangent and bitangent are stored as a QTangent, a unit quaternion of the
+// orthonormalized tangent frame. Sign of w is the bitangent handedness.
+struct sModelVtxPacked {
+	vec3 pos;
+	int16_t qtgt[4];   // SNORM16
+	uint16_t uv[2];    // half
+	uint16_t uv1[2];   // half
+	uint8_t clr[4];    // UNORM8
+};
+
+struct sModelVtxPackedSkin {
+	vec3 pos;
+	int16_t qtgt[4];
+	uint16_t uv[2];
+	uint16_t uv1[2];
+	uint8_t clr[4];
+	uint8_t jidx[4];
+	uint8_t jwgt[4];   // UNORM8, sums to 255
+};
+
+// Streams of passes which only need positions, next to the full layout.
+// Slot 0 holds vec3 positions, slot 1 the joints of skinned models.
+struct sModelVtxJnt {
+	uint8_t jidx[4];
+	uint8_t jwgt[4];   // UNORM8, sums to 255
+};
+
+// Per-instance stream of instanced draws, bound to slot 1 next to the model vertices.
+// World matrix is transposed without the constant column, like the skin palette.
+struct sInstanceData {
+	vec4 wmtx[3];
+	vec4 tint;         // multiplies the vertex color
+};
+
+namespace nVtxFmt {
+
+struct sError {
+	float mPos = 0.0f;
+	float mNrm = 0.0f;
+	float mTgt = 0.0f;
+	float mUV = 0.0f;
+	float mClr = 0.0f;
+	float mWgt = 0.0f;
+};
+
+cstr get_name(eVtxFmt fmt);
+uint32_t get_size(eVtxFmt fmt);
+
+// Smallest layout which represents the vertices without visible loss,
+// E_VTX_FMT_F32 if no packed layout fits.
+eVtxFmt choose(sModelVtx const* pVtx, uint32_t num);
+
+void encode(eVtxFmt fmt, sModelVtx const* pSrc, uint32_t num, void* pDst);
+void decode(eVtxFmt fmt, void const* pSrc, uint32_t num, sModelVtx* pDst);
+// Max error of the encode/decode round trip, vector distance or scalar difference.
+// Frame vectors are compared after orthonormalization, which is the expected loss of QTangent.
+sError round_trip_error(eVtxFmt fmt, sModelVtx const* pSrc, uint32_t num);
+
+D3D11_INPUT_ELEMENT_DESC const* get_input_desc(eVtxFmt fmt, uint32_t& num);
+// Vertex shader which declares all elements of the layout, used to create the input layout
+cstr get_layout_vs(eVtxFmt fmt);
+// Packed layouts use "<name>_packed.vs.cso" variants of the model vertex shaders
+std::string get_vs_variant(std::string const& vsProg, eVtxFmt fmt);
+
+// Position and joint stream layouts and vertex shaders
+D3D11_INPUT_ELEMENT_DESC const* get_depth_input_desc(bool isSkinned, uint32_t& num);
+cstr get_depth_layout_vs(bool isSkinned);
+// "<name>_depth.vs.cso" variant of a model vertex shader
+std::string get_depth_vs_variant(std::string const& vsProg);
+
+// Layout of fmt followed by the sInstanceData elements. Skinned layouts have no instanced variant,
+// get_inst_layout_vs returns nullptr for them.
+void get_inst_input_desc(eVtxFmt fmt, std::vector<D3D11_INPUT_ELEMENT_DESC>& desc);
+cstr get_inst_layout_vs(eVtxFmt fmt);
+// "<name>_inst.vs.cso" variant of a model vertex shader
+std::string get_inst_vs_variant(std::string const& vsProg);
+
+void encode_pos(sModelVtx const* pSrc, uint32_t num, vec3* pDst);
+// Unused influences get joint 0 with zero weight
+void encode_jnt(sModelVtx const* pSrc, uint32_t num, sModelVtxJnt* pDst);
+
+void encode_qtangent(DirectX::FXMVECTOR nrm, DirectX::FXMVECTOR tgt, DirectX::FXMVECTOR bitgt, int16_t* pQ);
+void decode_qtangent(int16_t const* pQ, DirectX::XMVECTOR& nrm, DirectX::XMVECTOR& tgt, DirectX::XMVECTOR& bitgt);
+// Quantizes weights renormalized to sum exactly to 255
+void encode_weights(vec4 const& wgt, uint8_t* pW);
+
+} // namespace nVtxFmt
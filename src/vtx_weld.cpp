@@ -0,0 +1,190 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "common.hpp"
+#include "math.hpp"
+#include "rdr.hpp"
+#include "model_src.hpp"
+#include "parallel.hpp"
+#include "vtx_weld.hpp"
+
+#include <cassert>
+
+namespace nVtxWeld {
+
+struct sCellKey {
+	uint64_t mKey;
+	uint32_t mVtx;
+
+	bool operator<(sCellKey const& o) const {
+		return mKey < o.mKey || (mKey == o.mKey && mVtx < o.mVtx);
+	}
+};
+
+static uint64_t hash_cell(int64_t x, int64_t y, int64_t z) {
+	uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull;
+	h ^= (uint64_t)y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+	h ^= (uint64_t)z * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+static uint64_t hash_bits(vec3 const& pos) {
+	// +0 and -0 compare equal, so they must hash the same
+	float const val[3] = { pos.x + 0.0f, pos.y + 0.0f, pos.z + 0.0f };
+	uint32_t bits[3];
+	::memcpy(bits, val, sizeof(bits));
+	return hash_cell(bits[0], bits[1], bits[2]);
+}
+
+static bool near_eq(float const* pA, float const* pB, int num, float eps) {
+	for (int i = 0; i < num; ++i) {
+		if (!(std::abs(pA[i] - pB[i]) <= eps)) { return false; }
+	}
+	return true;
+}
+
+static bool can_weld(sModelVtx const& a, sModelVtx const& b, sVtxWeldEps const& eps) {
+	if (!near_eq(&a.pos.x, &b.pos.x, 3, eps.mPos)) { return false; }
+	if (!near_eq(&a.nrm.x, &b.nrm.x, 3, eps.mNrm)) { return false; }
+	if (!near_eq(&a.uv.x, &b.uv.x, 1, eps.mUV) || !near_eq(&a.uv.y, &b.uv.y, 1, eps.mUV)) { return false; }
+	if (!near_eq(&a.uv1.x, &b.uv1.x, 1, eps.mUV) || !near_eq(&a.uv1.y, &b.uv1.y, 1, eps.mUV)) { return false; }
+	if (!near_eq(&a.tgt.mVal.x, &b.tgt.mVal.x, 4, eps.mTgt)) { return false; }
+	if (!near_eq(&a.bitgt.x, &b.bitgt.x, 3, eps.mTgt)) { return false; }
+	if (!near_eq(&a.clr.x, &b.clr.x, 3, eps.mClr)) { return false; }
+	if (!near_eq(&a.jwgt.mVal.x, &b.jwgt.mVal.x, 4, eps.mWgt)) { return false; }
+	for (int i = 0; i < 4; ++i) {
+		const bool used = a.jwgt[i] > 0.0f || b.jwgt[i] > 0.0f;
+		if (used && a.jidx[i] != b.jidx[i]) { return false; }
+	}
+	return true;
+}
+
+// Counts distinct vertices referenced by a group
+static uint32_t count_grp_vtx(sModelSrcGroup const& grp, std::vector<uint32_t>& stamp, uint32_t id) {
+	uint32_t num = 0;
+	for (uint32_t idx : grp.mIdx) {
+		if (stamp[idx] != id) {
+			stamp[idx] = id;
+			++num;
+		}
+	}
+	return num;
+}
+
+sStats weld(sModelSrc& src) {
+	sStats stats;
+	auto const& eps = src.mWeldEps;
+	const uint32_t vtxNum = (uint32_t)src.mVtx.size();
+	const uint32_t grpNum = (uint32_t)src.mGroups.size();
+	stats.mVtxBefore = vtxNum;
+	stats.mVtxAfter = vtxNum;
+	if (!eps.mEnable || vtxNum < 2) { return stats; }
+
+	assert(std::all_of(src.mGroups.begin(), src.mGroups.end(),
+		[](sModelSrcGroup const& grp) { return grp.mSkinParts.empty(); }));
+
+	stats.mGroups.resize(grpNum);
+	std::vector<uint32_t> stamp(vtxNum, UINT32_MAX);
+	for (uint32_t i = 0; i < grpNum; ++i) {
+		stats.mGroups[i].mVtxBefore = count_grp_vtx(src.mGroups[i], stamp, i);
+	}
+
+	// Cells are twice the position tolerance, so matches of a vertex are in
+	// at most 2 cells per axis. Zero tolerance hashes the exact bits.
+	const bool exact = !(eps.mPos > 0.0f);
+	const double cellScale = exact ? 0.0 : 1.0 / (2.0 * eps.mPos);
+	auto cell_of = [&](float val) {
+		return (int64_t)std::floor(val * cellScale);
+	};
+
+	const uint32_t grain = 4096;
+	std::vector<sCellKey> keys(vtxNum);
+	nParallel::for_ranges(vtxNum, grain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			auto const& pos = src.mVtx[i].pos;
+			keys[i].mVtx = i;
+			keys[i].mKey = exact ? hash_bits(pos) : hash_cell(cell_of(pos.x), cell_of(pos.y), cell_of(pos.z));
+		}
+	});
+	std::sort(std::execution::par, keys.begin(), keys.end());
+
+	// Every vertex picks the lowest index it can be welded to
+	std::vector<uint32_t> rep(vtxNum);
+	nParallel::for_ranges(vtxNum, grain, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t v = begin; v < end; ++v) {
+			auto const& vtx = src.mVtx[v];
+			uint64_t query[27];
+			int queryNum = 0;
+			if (exact) {
+				query[queryNum++] = hash_bits(vtx.pos);
+			} else {
+				int64_t lo[3];
+				int64_t hi[3];
+				float const* pPos = &vtx.pos.x;
+				for (int i = 0; i < 3; ++i) {
+					lo[i] = cell_of(pPos[i] - eps.mPos);
+					hi[i] = cell_of(pPos[i] + eps.mPos);
+				}
+				for (int64_t x = lo[0]; x <= hi[0]; ++x) {
+					for (int64_t y = lo[1]; y <= hi[1]; ++y) {
+						for (int64_t z = lo[2]; z <= hi[2]; ++z) {
+							const uint64_t key = hash_cell(x, y, z);
+							if (std::find(query, query + queryNum, key) == query + queryNum) {
+								query[queryNum++] = key;
+							}
+						}
+					}
+				}
+			}
+
+			uint32_t best = v;
+			for (int q = 0; q < queryNum; ++q) {
+				auto itr = std::lower_bound(keys.begin(), keys.end(), sCellKey{ query[q], 0 });
+				for (; itr != keys.end() && itr->mKey == query[q] && itr->mVtx < best; ++itr) {
+					if (can_weld(src.mVtx[itr->mVtx], vtx, eps)) {
+						best = itr->mVtx;
+						break;
+					}
+				}
+			}
+			rep[v] = best;
+		}
+	});
+
+	// Representatives have lower indices, so a single ascending pass collapses the chains
+	std::vector<uint32_t> remap(vtxNum);
+	uint32_t next = 0;
+	for (uint32_t v = 0; v < vtxNum; ++v) {
+		if (rep[v] == v) {
+			remap[v] = next;
+			src.mVtx[next] = src.mVtx[v];
+			++next;
+		} else {
+			remap[v] = remap[rep[v]];
+		}
+	}
+	src.mVtx.resize(next);
+	stats.mVtxAfter = next;
+	if (next == vtxNum) {
+		for (auto& grpStats : stats.mGroups) {
+			grpStats.mVtxAfter = grpStats.mVtxBefore;
+		}
+		return stats;
+	}
+
+	for (auto& grp : src.mGroups) {
+		for (uint32_t& idx : grp.mIdx) {
+			idx = remap[idx];
+		}
+	}
+
+	std::fill(stamp.begin(), stamp.end(), UINT32_MAX);
+	for (uint32_t i = 0; i < grpNum; ++i) {
+		stats.mGroups[i].mVtxAfter = count_grp_vtx(src.mGroups[i], stamp, i);
+	}
+
+	return stats;
+}
+
+} // namespace nVtxWeld
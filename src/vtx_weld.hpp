@@ -0,0 +1,20 @@
+struct sModelSrc;
+
+namespace nVtxWeld {
+
+struct sGroupStats {
+	uint32_t mVtxBefore = 0;
+	uint32_t mVtxAfter = 0;
+};
+
+struct sStats {
+	uint32_t mVtxBefore = 0;
+	uint32_t mVtxAfter = 0;
+	std::vector<sGroupStats> mGroups;
+};
+
+// Merges vertices equal within src.mWeldEps, remaps group indices and drops
+// the merged vertices. Must run before skin partitioning.
+sStats weld(sModelSrc& src);
+
+} // namespace nVtxWeld